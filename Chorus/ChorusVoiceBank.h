@@ -0,0 +1,429 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "ControlRateLfo.h"
+#include "FractionalDelayLine.h"
+#include "StereoDelayLine.h"
+#include "BucketBrigade.h"
+
+#if JUCE_USE_SIMD && defined (__SSE2__)
+ #include <emmintrin.h>
+ #define CHORUS_VOICEBANK_SSE2 1
+#else
+ #define CHORUS_VOICEBANK_SSE2 0
+#endif
+
+//==============================================================================
+
+/*
+    The delayed voices of the chorus, stored structure-of-arrays: every voice
+    owns one lane of the phase, phase offset, LFO and gain arrays, and on SSE2
+    four voices advance together per step. For every sample each lane turns
+    its LFO value into a delay, reads the delay line through its own tap (the
+    four lanes of a group in one read4()) and adds the result to the output
+    with its gain; lanes past the active voices have a gain of zero.
+
+    process() handles one channel of a planar FractionalDelayLine.
+    processStereo() handles a pair stored interleaved in a StereoDelayLine:
+    the LFO, the delays and the interpolation weights are computed once per
+    sample for both channels, and each tap reads both with two loads. The
+    voices share their phases across channels; only the gains differ.
+
+    With setBucketBrigade(true) the delay line carries the compressed input
+    and every voice runs through its own BucketBrigade lane after the read.
+
+    The smoothed parameters arrive as Ramps: a value per sample while a
+    parameter moves, a single constant otherwise. Constant delay and width
+    keep the per-sample loop free of any parameter loads.
+
+    The LFO runs at control rate: the shared wavetables are looked up once
+    per voice every control period, and in between each lane only moves
+    along a straight line, so the per-sample LFO cost is one multiply-add
+    per lane. See ControlRateLfo for the error bound.
+*/
+
+class ChorusVoiceBank
+{
+public:
+    //==============================================================================
+
+    enum {
+        laneWidth = 4,
+        maxVoices = 16,
+        maxChannels = 2,
+    };
+
+    static_assert((int)BucketBrigade::maxVoices == (int)maxVoices && (int)BucketBrigade::maxChannels == (int)maxChannels,
+        "every voice needs a bucket-brigade lane");
+
+    // A parameter over one block: values[sample] when values is set,
+    // constant otherwise.
+    struct Ramp
+    {
+        const float* values;
+        float constant;
+
+        bool isConstant() const { return values == nullptr; }
+        float operator[](const int sample) const { return values != nullptr ? values[sample] : constant; }
+
+        float sum(const int start, const int numSamples) const
+        {
+            if (values == nullptr)
+                return constant * (float)numSamples;
+
+            float total = 0.0f;
+            for (int sample = start; sample < start + numSamples; sample++)
+                total += values[sample];
+            return total;
+        }
+    };
+
+    //==============================================================================
+
+    ChorusVoiceBank()
+    {
+        for (int voice = 0; voice < maxVoices; voice++) {
+            phaseOffsets[voice] = 0.0f;
+            phases[voice] = 0.0f;
+            lfoValues[voice] = 0.0f;
+            lfoSteps[voice] = 0.0f;
+
+            for (int channel = 0; channel < maxChannels; channel++)
+                gains[channel][voice] = 0.0f;
+        }
+    }
+
+    //==============================================================================
+
+    void setSampleRate(const double sampleRate) { bucketBrigade.setSampleRate(sampleRate); }
+    void setControlPeriod(const int numSamples) { lfo.setControlPeriod(numSamples); }
+
+    void setBucketBrigade(const bool shouldEmulateBucketBrigade) { bucketBrigadeMode = shouldEmulateBucketBrigade; }
+    bool isBucketBrigade() const { return bucketBrigadeMode; }
+
+    void clear() { bucketBrigade.clear(); }
+
+    void setNumVoices(const int numVoicesToUse)
+    {
+        numVoices = jlimit(0, (int)maxVoices, numVoicesToUse);
+        numGroups = (numVoices + laneWidth - 1) / laneWidth;
+
+        for (int voice = numVoices; voice < maxVoices; voice++) {
+            phaseOffsets[voice] = 0.0f;
+
+            for (int channel = 0; channel < maxChannels; channel++)
+                gains[channel][voice] = 0.0f;
+        }
+    }
+
+    void setVoice(const int voice, const float phaseOffset)
+    {
+        jassert(voice >= 0 && voice < numVoices);
+        phaseOffsets[voice] = phaseOffset - floorf(phaseOffset);
+    }
+
+    void setGain(const int channel, const int voice, const float gain)
+    {
+        jassert(channel >= 0 && channel < maxChannels);
+        jassert(voice >= 0 && voice < numVoices);
+        gains[channel][voice] = gain;
+    }
+
+    //==============================================================================
+
+    // Replaces channelData with dryGain times the input plus depth times the
+    // voices, weighted by their gains for the channel and read from the
+    // channel's delay line before the input is written to it. Delays are in
+    // samples; each voice is delayed by delay + width * lfo, with the lfo in
+    // [0, 1]. The delay line needs a tap per voice (maxVoices) and is not
+    // advanced, so every channel starts from the same write position. Returns
+    // the LFO phase after the block.
+    template <class Interpolation>
+    float process(float* channelData,
+        FractionalDelayLine<Interpolation>& delayLine,
+        const int channel,
+        const int numSamples,
+        const int waveform,
+        float lfoPhase,
+        const Ramp& phaseIncrement,
+        const Ramp& delay,
+        const Ramp& width,
+        const Ramp& depth,
+        const float dryGain)
+    {
+        jassert(channel >= 0 && channel < maxChannels);
+        const int writePosition = delayLine.getWritePosition();
+
+        return runSegments(numSamples, waveform, lfoPhase, phaseIncrement, [&](const int start, const int segmentLength) {
+            if (delay.isConstant() && width.isConstant())
+                processSegment<false>(channelData, delayLine, channel, writePosition, start, segmentLength,
+                    delay, width, depth, dryGain);
+            else
+                processSegment<true>(channelData, delayLine, channel, writePosition, start, segmentLength,
+                    delay, width, depth, dryGain);
+        });
+    }
+
+    // As process(), for both channels of a stereo pair at once.
+    float processStereo(float* left,
+        float* right,
+        StereoDelayLine& delayLine,
+        const int numSamples,
+        const int waveform,
+        float lfoPhase,
+        const Ramp& phaseIncrement,
+        const Ramp& delay,
+        const Ramp& width,
+        const Ramp& depth,
+        const float dryGainLeft,
+        const float dryGainRight)
+    {
+        const int writePosition = delayLine.getWritePosition();
+
+        return runSegments(numSamples, waveform, lfoPhase, phaseIncrement, [&](const int start, const int segmentLength) {
+            if (delay.isConstant() && width.isConstant())
+                processStereoSegment<false>(left, right, delayLine, writePosition, start, segmentLength,
+                    delay, width, depth, dryGainLeft, dryGainRight);
+            else
+                processStereoSegment<true>(left, right, delayLine, writePosition, start, segmentLength,
+                    delay, width, depth, dryGainLeft, dryGainRight);
+        });
+    }
+
+private:
+    //==============================================================================
+
+    // Splits the block into control periods. For each one it moves every
+    // lane's phase on, sets the lanes' LFO lines from the values at both ends
+    // of the period and calls processSegment(start, segmentLength).
+    template <class SegmentFunction>
+    float runSegments(const int numSamples, const int waveform, float lfoPhase, const Ramp& phaseIncrement,
+        SegmentFunction&& processSegment)
+    {
+        const int numLanes = numGroups * laneWidth;
+        const int controlPeriod = lfo.getControlPeriod();
+
+        for (int voice = 0; voice < numLanes; voice++) {
+            const float phase = lfoPhase + phaseOffsets[voice];
+            phases[voice] = phase - floorf(phase);
+            lfoValues[voice] = lfo.getValue(waveform, phases[voice]);
+        }
+
+        for (int start = 0; start < numSamples; start += controlPeriod) {
+            const int segmentLength = jmin(controlPeriod, numSamples - start);
+            const float segmentAdvance = phaseIncrement.sum(start, segmentLength);
+            const float inverseLength = 1.0f / (float)segmentLength;
+            float targets[maxVoices];
+
+            for (int voice = 0; voice < numLanes; voice++) {
+                float phase = phases[voice] + segmentAdvance;
+                phase -= floorf(phase);
+                phases[voice] = phase;
+
+                targets[voice] = lfo.getValue(waveform, phase);
+                lfoSteps[voice] = (targets[voice] - lfoValues[voice]) * inverseLength;
+            }
+
+            processSegment(start, segmentLength);
+
+            for (int voice = 0; voice < numLanes; voice++)
+                lfoValues[voice] = targets[voice];
+
+            lfoPhase += segmentAdvance;
+            lfoPhase -= floorf(lfoPhase);
+        }
+
+        return lfoPhase;
+    }
+
+    //==============================================================================
+
+    // Processes the samples [start, start + numSamples) of the block; the
+    // LFO lines start at the segment.
+    template <bool rampedDelay, class Interpolation>
+    void processSegment(float* channelData,
+        FractionalDelayLine<Interpolation>& delayLine,
+        const int channel,
+        const int writePosition,
+        const int start,
+        const int numSamples,
+        const Ramp& delay,
+        const Ramp& width,
+        const Ramp& depth,
+        const float dryGain)
+    {
+#if CHORUS_VOICEBANK_SSE2
+        __m128 delay4 = _mm_set1_ps(delay.constant);
+        __m128 width4 = _mm_set1_ps(width.constant);
+
+        for (int sample = 0; sample < numSamples; sample++) {
+            const int index = start + sample;
+            const float input = channelData[index];
+            const int position = writePosition + index;
+            const __m128 elapsed = _mm_set1_ps((float)sample);
+            __m128 sum = _mm_setzero_ps();
+
+            if (rampedDelay) {
+                delay4 = _mm_set1_ps(delay[index]);
+                width4 = _mm_set1_ps(width[index]);
+            }
+
+            for (int group = 0; group < numGroups * laneWidth; group += laneWidth) {
+                const __m128 lfoValue = _mm_add_ps(_mm_loadu_ps(lfoValues + group),
+                                                   _mm_mul_ps(_mm_loadu_ps(lfoSteps + group), elapsed));
+
+                const __m128 voiceDelay = _mm_add_ps(delay4, _mm_mul_ps(width4, lfoValue));
+                __m128 delayed = delayLine.read4(channel, group, position, voiceDelay);
+                if (bucketBrigadeMode)
+                    delayed = bucketBrigade.processVoices(channel, group, delayed, voiceDelay);
+
+                sum = _mm_add_ps(sum, _mm_mul_ps(delayed, _mm_loadu_ps(gains[channel] + group)));
+            }
+
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+            channelData[index] = dryGain * input + depth[index] * _mm_cvtss_f32(sum);
+            delayLine.write(channel, position, bucketBrigadeMode ? bucketBrigade.processInput(channel, input) : input);
+        }
+#else
+        for (int sample = 0; sample < numSamples; sample++) {
+            const int index = start + sample;
+            const float input = channelData[index];
+            const int position = writePosition + index;
+            const float sampleDelay = rampedDelay ? delay[index] : delay.constant;
+            const float sampleWidth = rampedDelay ? width[index] : width.constant;
+            float sum = 0.0f;
+
+            for (int voice = 0; voice < numVoices; voice++) {
+                const float lfoValue = lfoValues[voice] + lfoSteps[voice] * (float)sample;
+                const float voiceDelay = sampleDelay + sampleWidth * lfoValue;
+                float delayed = delayLine.read(channel, voice, position, voiceDelay);
+                if (bucketBrigadeMode)
+                    delayed = bucketBrigade.processVoice(channel, voice, delayed, voiceDelay);
+
+                sum += delayed * gains[channel][voice];
+            }
+
+            channelData[index] = dryGain * input + depth[index] * sum;
+            delayLine.write(channel, position, bucketBrigadeMode ? bucketBrigade.processInput(channel, input) : input);
+        }
+#endif
+    }
+
+    template <bool rampedDelay>
+    void processStereoSegment(float* left,
+        float* right,
+        StereoDelayLine& delayLine,
+        const int writePosition,
+        const int start,
+        const int numSamples,
+        const Ramp& delay,
+        const Ramp& width,
+        const Ramp& depth,
+        const float dryGainLeft,
+        const float dryGainRight)
+    {
+#if CHORUS_VOICEBANK_SSE2 && STEREODELAY_SSE2
+        __m128 delay4 = _mm_set1_ps(delay.constant);
+        __m128 width4 = _mm_set1_ps(width.constant);
+
+        for (int sample = 0; sample < numSamples; sample++) {
+            const int index = start + sample;
+            const float inputLeft = left[index];
+            const float inputRight = right[index];
+            const int position = writePosition + index;
+            const __m128 elapsed = _mm_set1_ps((float)sample);
+            __m128 sumLeft = _mm_setzero_ps();
+            __m128 sumRight = _mm_setzero_ps();
+
+            if (rampedDelay) {
+                delay4 = _mm_set1_ps(delay[index]);
+                width4 = _mm_set1_ps(width[index]);
+            }
+
+            for (int group = 0; group < numGroups * laneWidth; group += laneWidth) {
+                const __m128 lfoValue = _mm_add_ps(_mm_loadu_ps(lfoValues + group),
+                                                   _mm_mul_ps(_mm_loadu_ps(lfoSteps + group), elapsed));
+
+                const __m128 voiceDelay = _mm_add_ps(delay4, _mm_mul_ps(width4, lfoValue));
+                __m128 delayedLeft, delayedRight;
+                delayLine.read4(position, voiceDelay, delayedLeft, delayedRight);
+
+                if (bucketBrigadeMode) {
+                    delayedLeft = bucketBrigade.processVoices(0, group, delayedLeft, voiceDelay);
+                    delayedRight = bucketBrigade.processVoices(1, group, delayedRight, voiceDelay);
+                }
+
+                sumLeft = _mm_add_ps(sumLeft, _mm_mul_ps(delayedLeft, _mm_loadu_ps(gains[0] + group)));
+                sumRight = _mm_add_ps(sumRight, _mm_mul_ps(delayedRight, _mm_loadu_ps(gains[1] + group)));
+            }
+
+            // (l0 + l2, r0 + r2, l1 + l3, r1 + r3), then the halves together.
+            __m128 sum = _mm_add_ps(_mm_unpacklo_ps(sumLeft, sumRight), _mm_unpackhi_ps(sumLeft, sumRight));
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+
+            const float wet = depth[index];
+            left[index] = dryGainLeft * inputLeft + wet * _mm_cvtss_f32(sum);
+            right[index] = dryGainRight * inputRight + wet * _mm_cvtss_f32(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+            if (bucketBrigadeMode)
+                delayLine.write(position, bucketBrigade.processInput(0, inputLeft), bucketBrigade.processInput(1, inputRight));
+            else
+                delayLine.write(position, inputLeft, inputRight);
+        }
+#else
+        for (int sample = 0; sample < numSamples; sample++) {
+            const int index = start + sample;
+            const float inputLeft = left[index];
+            const float inputRight = right[index];
+            const int position = writePosition + index;
+            const float sampleDelay = rampedDelay ? delay[index] : delay.constant;
+            const float sampleWidth = rampedDelay ? width[index] : width.constant;
+            float sumLeft = 0.0f;
+            float sumRight = 0.0f;
+
+            for (int voice = 0; voice < numVoices; voice++) {
+                const float lfoValue = lfoValues[voice] + lfoSteps[voice] * (float)sample;
+                const float voiceDelay = sampleDelay + sampleWidth * lfoValue;
+                float delayedLeft, delayedRight;
+                delayLine.read(position, voiceDelay, delayedLeft, delayedRight);
+
+                if (bucketBrigadeMode) {
+                    delayedLeft = bucketBrigade.processVoice(0, voice, delayedLeft, voiceDelay);
+                    delayedRight = bucketBrigade.processVoice(1, voice, delayedRight, voiceDelay);
+                }
+
+                sumLeft += delayedLeft * gains[0][voice];
+                sumRight += delayedRight * gains[1][voice];
+            }
+
+            left[index] = dryGainLeft * inputLeft + depth[index] * sumLeft;
+            right[index] = dryGainRight * inputRight + depth[index] * sumRight;
+            if (bucketBrigadeMode)
+                delayLine.write(position, bucketBrigade.processInput(0, inputLeft), bucketBrigade.processInput(1, inputRight));
+            else
+                delayLine.write(position, inputLeft, inputRight);
+        }
+#endif
+    }
+
+    //==============================================================================
+
+    ControlRateLfo lfo;
+    BucketBrigade bucketBrigade;
+    bool bucketBrigadeMode = false;
+
+    int numVoices = 0;
+    int numGroups = 0;
+
+    float phaseOffsets[maxVoices];
+    float phases[maxVoices];
+    float lfoValues[maxVoices];
+    float lfoSteps[maxVoices];
+    float gains[maxChannels][maxVoices];
+
+    //==============================================================================
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ChorusVoiceBank)
+};
+
+//==============================================================================
@@ -0,0 +1,290 @@
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_USE_SIMD && defined (__SSE2__)
+ #include <emmintrin.h>
+ #define CONTROLRATELFO_SSE2 1
+#else
+ #define CONTROLRATELFO_SSE2 0
+#endif
+
+//==============================================================================
+
+/*
+    Read-only LFO wavetables shared by every plugin instance in the process
+    through a SharedResourcePointer. Every shape maps a phase in [0, 1) to
+    [0, 1] and starts at 0.5 (the sawtooths rising or falling from there, the
+    triangle and sine rising). The shapes are band-limited to numHarmonics
+    harmonics with Lanczos sigma factors against Gibbs ringing and rescaled
+    so that their range is exactly [0, 1]; the modulation depth therefore
+    stays the one set on the plugin. With a 10 Hz LFO the highest harmonic
+    sits at 320 Hz, below the Nyquist frequency of any control period up to
+    64 samples at 44.1 kHz; a faster LFO needs a proportionally shorter
+    period, which ControlRateLfo::getControlPeriodFor() picks.
+*/
+
+class LfoWavetables
+{
+public:
+    //==============================================================================
+
+    enum waveform {
+        waveformSine = 0,
+        waveformTriangle,
+        waveformSawtooth,
+        waveformInverseSawtooth,
+        numWaveforms,
+    };
+
+    enum {
+        tableSize = 2048,
+        numHarmonics = 32,
+    };
+
+    //==============================================================================
+
+    LfoWavetables()
+    {
+        for (int shape = 0; shape < numWaveforms; shape++) {
+            HeapBlock<double> values(tableSize);
+            double minimum = 1.0;
+            double maximum = 0.0;
+
+            for (int index = 0; index < tableSize; index++) {
+                values[index] = getBandLimitedValue(shape, (double)index / (double)tableSize);
+                minimum = jmin(minimum, values[index]);
+                maximum = jmax(maximum, values[index]);
+            }
+
+            tables[shape].malloc(tableSize + 1);
+            for (int index = 0; index < tableSize; index++)
+                tables[shape][index] = (float)((values[index] - minimum) / (maximum - minimum));
+            tables[shape][tableSize] = tables[shape][0];
+        }
+    }
+
+    //==============================================================================
+
+    float lookup(const int shape, const float phase) const
+    {
+        return interpolate(tables[jlimit(0, numWaveforms - 1, shape)], phase);
+    }
+
+    template <int shape>
+    float lookup(const float phase) const
+    {
+        static_assert(shape >= 0 && shape < numWaveforms, "unknown waveform");
+        return interpolate(tables[shape], phase);
+    }
+
+private:
+    //==============================================================================
+
+    static float interpolate(const float* table, const float phase)
+    {
+        const float position = phase * (float)tableSize;
+        const int index = jlimit(0, tableSize - 1, (int)position);
+        const float fraction = position - (float)index;
+
+        return table[index] + fraction * (table[index + 1] - table[index]);
+    }
+
+    static double getBandLimitedValue(const int shape, const double phase)
+    {
+        if (shape == waveformSine)
+            return 0.5 + 0.5 * sin(2.0 * M_PI * phase);
+
+        double sum = 0.0;
+        for (int harmonic = 1; harmonic <= numHarmonics; harmonic++) {
+            const double x = M_PI * (double)harmonic / (double)(numHarmonics + 1);
+            const double sigma = sin(x) / x;
+            const double sine = sin(2.0 * M_PI * (double)harmonic * phase);
+
+            if (shape == waveformTriangle) {
+                if (harmonic % 2 == 1)
+                    sum += sigma * ((harmonic / 2) % 2 == 0 ? 1.0 : -1.0) * sine / (double)(harmonic * harmonic);
+            }
+            else {
+                sum += sigma * (harmonic % 2 == 0 ? 1.0 : -1.0) * sine / (double)harmonic;
+            }
+        }
+
+        if (shape == waveformTriangle)
+            return 0.5 + 4.0 / (M_PI * M_PI) * sum;
+
+        const double sawtooth = 0.5 - sum / M_PI;
+        return shape == waveformSawtooth ? sawtooth : 1.0 - sawtooth;
+    }
+
+    //==============================================================================
+
+    HeapBlock<float> tables[numWaveforms];
+
+    //==============================================================================
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LfoWavetables)
+};
+
+//==============================================================================
+
+/*
+    Evaluates the shared wavetables only every controlPeriod samples and
+    interpolates linearly in between. The grid restarts at every render()
+    call, so the first value of a block is always exact; renderLocked()
+    keeps it on a timeline instead.
+
+    The error is that of a straight line through points N samples apart, so
+    it grows with (f N)^2 for an LFO at f Hz. Against the per-sample table at
+    10 Hz (the fastest free-running LFO of these plugins) and 48 kHz, the
+    largest deviation with the default period of 32 samples is 1.2e-4
+    (sine), 8.8e-4 (triangle) and 1.3e-2 (sawtooths, inside their
+    band-limited flyback) of the modulation depth. Halving N divides it by
+    four; at 2 Hz it is 25 times smaller. Tempo-synced LFOs can run faster;
+    getControlPeriodFor() shortens the period for them so that f N, and
+    with it both the error and the table harmonics against the control
+    Nyquist frequency, stays within its 10 Hz value.
+*/
+
+class ControlRateLfo
+{
+public:
+    //==============================================================================
+
+    enum {
+        defaultControlPeriod = 32,
+    };
+
+    ControlRateLfo() {}
+
+    //==============================================================================
+
+    void setControlPeriod(const int numSamples) { controlPeriod = jmax(1, numSamples); }
+    int getControlPeriod() const { return controlPeriod; }
+
+    // The longest power-of-two period, up to the default one, that keeps an
+    // LFO at frequency Hz within the bounds of a 10 Hz LFO at the default
+    // period. Powers of two keep every shorter grid on the longer ones.
+    static int getControlPeriodFor(const double frequency)
+    {
+        const double maxFrequencyTimesPeriod = 10.0 * (double)defaultControlPeriod;
+
+        int period = defaultControlPeriod;
+        while (period > 1 && frequency * (double)period > maxFrequencyTimesPeriod)
+            period /= 2;
+
+        return period;
+    }
+
+    float getValue(const int waveform, const float phase) const
+    {
+        return tables->lookup(waveform, phase);
+    }
+
+    //==============================================================================
+
+    // Writes the LFO for numSamples samples from phase onwards and returns the
+    // phase that follows them. The waveform is dispatched once per call to a
+    // kernel specialised for it.
+    float render(float* destination, const int numSamples, const int waveform, const float phase, const float phaseIncrement) const
+    {
+        switch (waveform) {
+            case LfoWavetables::waveformTriangle:
+                return render<LfoWavetables::waveformTriangle>(destination, numSamples, phase, phaseIncrement);
+            case LfoWavetables::waveformSawtooth:
+                return render<LfoWavetables::waveformSawtooth>(destination, numSamples, phase, phaseIncrement);
+            case LfoWavetables::waveformInverseSawtooth:
+                return render<LfoWavetables::waveformInverseSawtooth>(destination, numSamples, phase, phaseIncrement);
+            default:
+                return render<LfoWavetables::waveformSine>(destination, numSamples, phase, phaseIncrement);
+        }
+    }
+
+    template <int waveform>
+    float render(float* destination, const int numSamples, float phase, const float phaseIncrement) const
+    {
+        const LfoWavetables& wavetables = *tables;
+        float value = wavetables.lookup<waveform>(phase);
+
+        for (int start = 0; start < numSamples; start += controlPeriod) {
+            const int segmentLength = jmin(controlPeriod, numSamples - start);
+
+            phase += phaseIncrement * (float)segmentLength;
+            phase -= floorf(phase);
+
+            const float target = wavetables.lookup<waveform>(phase);
+            fillRamp(destination + start, segmentLength, value, (target - value) / (float)segmentLength);
+            value = target;
+        }
+
+        return phase;
+    }
+
+    // As render(), for an LFO locked to a timeline. The control points sit
+    // on the samples whose timeline position is a multiple of the control
+    // period; the sample firstSample after the one at timelinePosition has
+    // the phase startPhase + firstSample * phaseIncrement, evaluated in
+    // double. Every value depends only on its place on the timeline, so a
+    // timeline renders the same however it is cut into blocks.
+    void renderLocked(float* destination, const int numSamples, const int waveform, const double startPhase,
+        const double phaseIncrement, const int64 timelinePosition, const int firstSample) const
+    {
+        const int64 position = timelinePosition + firstSample;
+        int point = firstSample - (int)(((position % controlPeriod) + controlPeriod) % controlPeriod);
+        float value = getValue(waveform, getLockedPhase(startPhase, phaseIncrement, point));
+
+        for (int sample = firstSample; sample < firstSample + numSamples;) {
+            const int nextPoint = point + controlPeriod;
+            const int end = jmin(nextPoint, firstSample + numSamples);
+
+            const float target = getValue(waveform, getLockedPhase(startPhase, phaseIncrement, nextPoint));
+            fillRamp(destination + sample - firstSample, end - sample, value, (target - value) / (float)controlPeriod, sample - point);
+
+            value = target;
+            point = nextPoint;
+            sample = end;
+        }
+    }
+
+    static float getLockedPhase(const double startPhase, const double phaseIncrement, const int sample)
+    {
+        const double phase = startPhase + (double)sample * phaseIncrement;
+        return (float)(phase - floor(phase));
+    }
+
+    // destination[i] = start + (firstIndex + i) * step
+    static void fillRamp(float* destination, const int numSamples, const float start, const float step, const int firstIndex = 0)
+    {
+        int sample = 0;
+
+#if CONTROLRATELFO_SSE2
+        const __m128 start4 = _mm_set1_ps(start);
+        const __m128 step4 = _mm_set1_ps(step);
+        const __m128 four = _mm_set1_ps(4.0f);
+        __m128 index = _mm_add_ps(_mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f), _mm_set1_ps((float)firstIndex));
+
+        for (; sample + 4 <= numSamples; sample += 4) {
+            _mm_storeu_ps(destination + sample, _mm_add_ps(start4, _mm_mul_ps(step4, index)));
+            index = _mm_add_ps(index, four);
+        }
+#endif
+
+        for (; sample < numSamples; sample++)
+            destination[sample] = start + (float)(firstIndex + sample) * step;
+    }
+
+private:
+    //==============================================================================
+
+    SharedResourcePointer<LfoWavetables> tables;
+    int controlPeriod = defaultControlPeriod;
+
+    //==============================================================================
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ControlRateLfo)
+};
+
+//==============================================================================
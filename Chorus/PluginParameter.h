@@ -3,6 +3,10 @@
 #include "../JuceLibraryCode/JuceHeader.h"
 using Parameter = AudioProcessorValueTreeState::Parameter;
 
+#if JUCE_USE_SIMD && defined (__SSE2__)
+ #include <emmintrin.h>
+#endif
+
 //==============================================================================
 
 class PluginParametersManager
@@ -35,9 +39,9 @@ public:
     void updateValue (float value)
     {
         if (callback != nullptr)
-            setCurrentAndTargetValue (callback (value));
+            setTargetValue (callback (value));
         else
-            setCurrentAndTargetValue (value);
+            setTargetValue (value);
     }
 
     void parameterChanged (const String& parameterID, float newValue) override
@@ -45,6 +49,61 @@ public:
         updateValue (newValue);
     }
 
+    // Advances the smoothing by a whole block. While the value is moving it
+    // writes the value of every sample to ramp and returns true; otherwise
+    // ramp is left untouched and getCurrentValue() holds for the block.
+    bool getNextRamp (float* ramp, const int numSamples)
+    {
+        if (! isSmoothing() || numSamples <= 0)
+            return false;
+
+        const float start = getCurrentValue();
+        const float first = getNextValue();
+        const float step = first - start;
+        const float target = getTargetValue();
+
+        // An increment below float resolution at this value leaves no step
+        // to divide by; the ramp is then within a few ulps of its target.
+        if (step == 0.0f) {
+            FloatVectorOperations::fill (ramp, target, numSamples);
+            skip (numSamples - 1);
+            return true;
+        }
+
+        int numRampSamples = numSamples;
+        if (! isSmoothing())
+            numRampSamples = 1;
+        else if ((target - first) / step < (float)(numSamples - 1))
+            numRampSamples = jlimit (1, numSamples, 1 + roundToInt ((target - first) / step));
+
+        fillLinear (ramp, numRampSamples, first, step);
+        FloatVectorOperations::fill (ramp + numRampSamples, target, numSamples - numRampSamples);
+        skip (numSamples - 1);
+
+        return true;
+    }
+
+    // destination[i] = start + i * step
+    static void fillLinear (float* destination, const int numSamples, const float start, const float step)
+    {
+        int sample = 0;
+
+#if JUCE_USE_SIMD && defined (__SSE2__)
+        const __m128 start4 = _mm_set1_ps (start);
+        const __m128 step4 = _mm_set1_ps (step);
+        const __m128 four = _mm_set1_ps (4.0f);
+        __m128 index = _mm_setr_ps (0.0f, 1.0f, 2.0f, 3.0f);
+
+        for (; sample + 4 <= numSamples; sample += 4) {
+            _mm_storeu_ps (destination + sample, _mm_add_ps (start4, _mm_mul_ps (step4, index)));
+            index = _mm_add_ps (index, four);
+        }
+#endif
+
+        for (; sample < numSamples; ++sample)
+            destination[sample] = start + (float)sample * step;
+    }
+
     PluginParametersManager& parametersManager;
     std::function<float (float)> callback;
     String paramID;
@@ -19,10 +19,11 @@ ChorusAudioProcessor::ChorusAudioProcessor() :
     , delaySlider(ppManager, "Delay", "ms", 10.0f, 50.0f, 30.0f, [](float value) { return value * 0.001f; })
     , widthSlider(ppManager, "Width", "ms", 10.0f, 50.0f, 20.0f, [](float value) { return value * 0.001f; })
     , depthSlider(ppManager, "Depth", "", 0.0f, 1.0f, 1.0f)
-    , voiceBox(ppManager, "Number of voices", { "2", "3", "4", "5" }, 0, [](float value) { return value + 2; })
+    , voiceBox(ppManager, "Number of voices", voicesUI, 0, [](float value) { return value + 2; })
     , freqSlider(ppManager, "LFO Frequency", "Hz", 0.05f, 2.0f, 0.2f)
     , waveformBox(ppManager, "LFO Waveform", waveformUI, waveformSine)
     , stereoButton(ppManager, "Stereo", true)
+    , modeBox(ppManager, "Mode", modeUI, modeDigital)
 {
     ppManager.apvts.state = ValueTree(Identifier(getName().removeCharacters("- ")));
 }
@@ -43,22 +44,30 @@ void ChorusAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
     freqSlider.reset(sampleRate, smoothTime);
     waveformBox.reset(sampleRate, smoothTime);
     stereoButton.reset(sampleRate, smoothTime);
+    modeBox.reset(sampleRate, smoothTime);
 
     //======================================
 
     float maxDelayTime = delaySlider.maxValue + widthSlider.maxValue;
-    delayBufferSamples = (int)(maxDelayTime * (float)sampleRate) + 1;
-    if (delayBufferSamples < 1)
-        delayBufferSamples = 1;
+    const int maxDelaySamples = (int)(maxDelayTime * (float)sampleRate) + 1;
 
-    delayBufferChannels = getTotalNumInputChannels();
-    delayBuffer.setSize(delayBufferChannels, delayBufferSamples);
-    delayBuffer.clear();
+    // Stereo runs on the interleaved delay line, anything else per channel.
+    if (getTotalNumInputChannels() == 2) {
+        stereoDelayLine.setSize(maxDelaySamples);
+        delayLine.setSize(0, 0, ChorusVoiceBank::maxVoices);
+    }
+    else {
+        stereoDelayLine.setSize(0);
+        delayLine.setSize(getTotalNumInputChannels(), maxDelaySamples, ChorusVoiceBank::maxVoices);
+    }
+
+    voiceBank.setSampleRate(sampleRate);
+    voiceBank.clear();
 
     lfoPhase = 0.0f;
     inverseSR = 1.0f / (float)sampleRate;
 
-    delayWritePos = 0;
+    rampBuffer.setSize(numRamps, jmax(1, samplesPerBlock));
 }
 
 void ChorusAudioProcessor::releaseResources()
@@ -77,74 +86,83 @@ void ChorusAudioProcessor::processBlock(AudioSampleBuffer& buffer, MidiBuffer& m
 
     bool stereo = (bool)stereoButton.getTargetValue();
     int numVoices = (int)voiceBox.getTargetValue();
-    float depth = depthSlider.getNextValue();
-    float delayTime = delaySlider.getNextValue();
-    float width = widthSlider.getNextValue();
-    float frequency = freqSlider.getNextValue();
-
-    int writePos;
-    float phase;
-
-    for (int channel = 0; channel < numInputChannels; ++channel) {
-        
-        float* channelData = buffer.getWritePointer(channel);
-        float* delayData = delayBuffer.getWritePointer(channel);
-        
-        writePos = delayWritePos;
-        phase = lfoPhase;
-
-        for (int sample = 0; sample < numSamples; sample++) {
-            
-            const float input = channelData[sample];
-            float output = 0.0f;
-           
-            float weight = 1.0f;
-            float phaseOffset = .0f;
+    int waveform = (int)waveformBox.getTargetValue();
+    bool bucketBrigade = (int)modeBox.getTargetValue() == modeBucketBrigade;
+
+    const float sampleRate = (float)getSampleRate();
+
+    // The delay lines hold the compressed input in bucket-brigade mode, so
+    // their contents are dropped on a switch.
+    if (bucketBrigade != voiceBank.isBucketBrigade()) {
+        voiceBank.setBucketBrigade(bucketBrigade);
+        voiceBank.clear();
+        delayLine.clear();
+        stereoDelayLine.clear();
+    }
 
-            for (int voice = 0; voice < numVoices - 1; voice++) {
+    // The first voice is the dry signal; the others are delayed.
+    const int numDelayedVoices = numVoices - 1;
+    voiceBank.setNumVoices(numDelayedVoices);
 
-                if (stereo) {
-                    if (numVoices > 2) {
-                        weight = (float)voice / (float)(numVoices - 2);
-                        if (!channel) weight = 1.0f - weight;
-                    }
-                }
+    float dryGains[ChorusVoiceBank::maxChannels] = { 1.0f, 1.0f };
 
-                float currDelay = (delayTime + width * lowFrequencyOscillator(phase + phaseOffset, (int)waveformBox.getTargetValue())) * (float)getSampleRate();
+    for (int voice = 0; voice < numDelayedVoices; voice++) {
 
-                float readPos = fmodf((float)writePos - currDelay + (float)delayBufferSamples, delayBufferSamples);
-                
-                int currReadPos = floorf(readPos);
+        float phaseOffset = 0.0f;
 
-                float nearestSample = delayData[currReadPos % delayBufferSamples];
-                output = nearestSample;
+        if (numVoices == 3) phaseOffset = 0.25f * (float)voice;
+        else if (numVoices > 3) phaseOffset = (float)voice / (float)(numVoices - 1);
 
-                if (stereo) {
-                    if (numVoices == 2) {
-                        if (channel == 0) channelData[sample] = input;
-                        else channelData[sample] = output * depth;
-                    }
-                }
-                else channelData[sample] += output * depth * weight;
+        voiceBank.setVoice(voice, phaseOffset);
 
-                if (numVoices == 3) phaseOffset += 0.25f;
-                else if (numVoices > 3) phaseOffset += 1.0f / (float)(numVoices - 1);
+        for (int channel = 0; channel < ChorusVoiceBank::maxChannels; ++channel) {
+
+            float weight = 1.0f;
+
+            if (stereo) {
+                if (numVoices == 2) {
+                    weight = channel ? 1.0f : 0.0f;
+                    dryGains[channel] = 1.0f - weight;
+                }
+                else {
+                    weight = (float)voice / (float)(numVoices - 2);
+                    if (!channel) weight = 1.0f - weight;
+                }
             }
 
-            delayData[writePos] = input;
+            voiceBank.setGain(channel, voice, weight);
+        }
+    }
+
+    // Hosts may send blocks larger than announced in prepareToPlay().
+    const int rampSize = rampBuffer.getNumSamples();
 
-            writePos++;
+    for (int start = 0; start < numSamples; start += rampSize) {
+        const int numChunkSamples = jmin(rampSize, numSamples - start);
 
-            if (writePos >= delayBufferSamples) writePos -= delayBufferSamples;
+        const ChorusVoiceBank::Ramp delayTime = getRamp(delaySlider, rampDelay, numChunkSamples, sampleRate);
+        const ChorusVoiceBank::Ramp width = getRamp(widthSlider, rampWidth, numChunkSamples, sampleRate);
+        const ChorusVoiceBank::Ramp depth = getRamp(depthSlider, rampDepth, numChunkSamples, 1.0f);
+        const ChorusVoiceBank::Ramp phaseIncrement = getRamp(freqSlider, rampFrequency, numChunkSamples, inverseSR);
 
-            phase += frequency * inverseSR;
+        if (numInputChannels == 2) {
+            lfoPhase = voiceBank.processStereo(buffer.getWritePointer(0, start), buffer.getWritePointer(1, start),
+                stereoDelayLine, numChunkSamples, waveform, lfoPhase, phaseIncrement, delayTime, width, depth,
+                dryGains[0], dryGains[1]);
 
-            if (phase >= 1.0f) phase -= 1.0f;
+            stereoDelayLine.advance(numChunkSamples);
         }
-    }
+        else {
+            float nextPhase = lfoPhase;
 
-    delayWritePos = writePos;
-    lfoPhase = phase;
+            for (int channel = 0; channel < jmin(numInputChannels, (int)ChorusVoiceBank::maxChannels); ++channel)
+                nextPhase = voiceBank.process(buffer.getWritePointer(channel, start), delayLine, channel, numChunkSamples,
+                    waveform, lfoPhase, phaseIncrement, delayTime, width, depth, dryGains[channel]);
+
+            delayLine.advance(numChunkSamples);
+            lfoPhase = nextPhase;
+        }
+    }
 
     //======================================
 
@@ -154,48 +172,20 @@ void ChorusAudioProcessor::processBlock(AudioSampleBuffer& buffer, MidiBuffer& m
 
 //==============================================================================
 
-float ChorusAudioProcessor::lowFrequencyOscillator(float phase, int waveform)
+// Scaled per-sample values while the parameter is smoothing, a scaled
+// constant otherwise.
+ChorusVoiceBank::Ramp ChorusAudioProcessor::getRamp(PluginParameter& parameter, const int ramp, const int numSamples, const float scale)
 {
-    float out = 0.0f;
+    float* values = rampBuffer.getWritePointer(ramp);
 
-    switch (waveform) {
-    case waveformSine: {
-        out = 0.5f + 0.5f * sinf(2.0f * M_PI * phase);
-        break;
-    }
-    case waveformTriangle: {
-        if (phase < 0.25f)
-            out = 0.5f + 2.0f * phase;
-        else if (phase < 0.75f)
-            out = 1.0f - 2.0f * (phase - 0.25f);
-        else
-            out = 2.0f * (phase - 0.75f);
-        break;
-    }
-    case waveformSawtooth: {
-        if (phase < 0.5f)
-            out = 0.5f + phase;
-        else
-            out = phase - 0.5f;
-        break;
-    }
-    case waveformInverseSawtooth: {
-        if (phase < 0.5f)
-            out = 0.5f - phase;
-        else
-            out = 1.5f - phase;
-        break;
-    }
+    if (parameter.getNextRamp(values, numSamples)) {
+        FloatVectorOperations::multiply(values, scale, numSamples);
+        return { values, 0.0f };
     }
 
-    return out;
+    return { nullptr, parameter.getCurrentValue() * scale };
 }
 
-//==============================================================================
-
-
-
-
 
 
 //==============================================================================
@@ -5,6 +5,7 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "PluginParameter.h"
+#include "ChorusVoiceBank.h"
 
 //==============================================================================
 
@@ -86,17 +87,42 @@ public:
         "Inverse Sawtooth"
     };
 
+    enum modeIndex {
+        modeDigital = 0,
+        modeBucketBrigade,
+    };
+
+    StringArray modeUI = {
+        "Digital",
+        "Bucket brigade"
+    };
+
+    StringArray voicesUI = {
+        "2", "3", "4", "5", "6", "7", "8", "9",
+        "10", "11", "12", "13", "14", "15", "16", "17"
+    };
+
     //======================================
 
-    AudioSampleBuffer delayBuffer;
-    int delayBufferSamples;
-    int delayBufferChannels;
-    int delayWritePos;
+    FractionalDelayLine<DelayInterpolation::Hermite> delayLine;
+    StereoDelayLine stereoDelayLine;
 
     float lfoPhase;
     float inverseSR;
 
-    float lowFrequencyOscillator(float phase, int waveform);
+    ChorusVoiceBank voiceBank;
+
+    enum rampIndex {
+        rampDelay = 0,
+        rampWidth,
+        rampDepth,
+        rampFrequency,
+        numRamps,
+    };
+
+    AudioSampleBuffer rampBuffer;
+
+    ChorusVoiceBank::Ramp getRamp(PluginParameter& parameter, const int ramp, const int numSamples, const float scale);
 
     //======================================
 
@@ -110,6 +136,7 @@ public:
     PluginParameterLinSlider freqSlider;
     PluginParameterLinSlider depthSlider;
     PluginParameterComboBox waveformBox;
+    PluginParameterComboBox modeBox;
     
     
 
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "FractionalDelayLine.h"
+
+#if JUCE_USE_SIMD && defined (__SSE2__)
+ #include <emmintrin.h>
+ #define STEREODELAY_SSE2 1
+#else
+ #define STEREODELAY_SSE2 0
+#endif
+
+//==============================================================================
+
+/*
+    A Hermite-interpolated delay line for a stereo pair that stores every
+    frame as adjacent (left, right) floats. The four neighbours a tap needs
+    are then eight consecutive floats, two unaligned loads for both
+    channels, and the interpolation weights, which only depend on the
+    delay, are computed once for the pair. The first three frames are
+    mirrored past the end of the buffer so that no read window wraps.
+
+    Reads match FractionalDelayLine<DelayInterpolation::Hermite> on each
+    channel, up to float rounding.
+*/
+
+class StereoDelayLine
+{
+public:
+    //==============================================================================
+
+    enum {
+        minDelay = DelayInterpolation::Hermite::minDelay,
+        numGuardFrames = 3,
+    };
+
+    StereoDelayLine() {}
+
+    //==============================================================================
+
+    void setSize(const int maxDelaySamples)
+    {
+        size = nextPowerOfTwo(jmax(maxDelaySamples, (int)minDelay) + 3);
+        mask = size - 1;
+        maxDelay = (float)(size - 3);
+
+        frames.malloc(2 * (size + numGuardFrames));
+        clear();
+    }
+
+    void clear()
+    {
+        if (frames != nullptr)
+            frames.clear(2 * (size + numGuardFrames));
+        writePosition = 0;
+    }
+
+    //==============================================================================
+
+    int getSize() const { return size; }
+    int getWritePosition() const { return writePosition; }
+
+    void advance(const int numSamples)
+    {
+        writePosition = (writePosition + numSamples) & mask;
+    }
+
+    //==============================================================================
+
+    void write(const int position, const float left, const float right)
+    {
+        const int frame = position & mask;
+        frames[2 * frame] = left;
+        frames[2 * frame + 1] = right;
+
+        if (frame < numGuardFrames) {
+            frames[2 * (frame + size)] = left;
+            frames[2 * (frame + size) + 1] = right;
+        }
+    }
+
+    void read(const int position, float delay, float& left, float& right) const
+    {
+        delay = jlimit((float)minDelay, maxDelay, delay);
+        const int whole = (int)delay;
+        const float t = delay - (float)whole;
+
+        // Weights of the frames from the oldest (x2) to the newest (xm1).
+        const float w2 = t * t * (0.5f * t - 0.5f);
+        const float w1 = t * (0.5f + t * (2.0f - 1.5f * t));
+        const float w0 = 1.0f + t * t * (1.5f * t - 2.5f);
+        const float wm1 = t * (-0.5f + t * (1.0f - 0.5f * t));
+
+        const float* frame = frames + 2 * ((position - whole - 2) & mask);
+        left = w2 * frame[0] + w1 * frame[2] + w0 * frame[4] + wm1 * frame[6];
+        right = w2 * frame[1] + w1 * frame[3] + w0 * frame[5] + wm1 * frame[7];
+    }
+
+#if STEREODELAY_SSE2
+    // Reads four taps at once; left and right hold one tap per lane.
+    void read4(const int position, __m128 delay, __m128& left, __m128& right) const
+    {
+        delay = _mm_min_ps(_mm_max_ps(delay, _mm_set1_ps((float)minDelay)), _mm_set1_ps(maxDelay));
+        const __m128i whole = _mm_cvttps_epi32(delay);
+        const __m128 t = _mm_sub_ps(delay, _mm_cvtepi32_ps(whole));
+        const __m128 tt = _mm_mul_ps(t, t);
+        const __m128 half = _mm_set1_ps(0.5f);
+
+        __m128 w2 = _mm_mul_ps(tt, _mm_sub_ps(_mm_mul_ps(half, t), half));
+        __m128 w1 = _mm_mul_ps(t, _mm_add_ps(half, _mm_mul_ps(t, _mm_sub_ps(_mm_set1_ps(2.0f), _mm_mul_ps(_mm_set1_ps(1.5f), t)))));
+        __m128 w0 = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(tt, _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(1.5f), t), _mm_set1_ps(2.5f))));
+        __m128 wm1 = _mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(half, t))), half));
+
+        // One row of weights per tap.
+        _MM_TRANSPOSE4_PS(w2, w1, w0, wm1);
+
+        int first[4];
+        _mm_storeu_si128((__m128i*)first,
+            _mm_and_si128(_mm_sub_epi32(_mm_set1_epi32(position - 2), whole), _mm_set1_epi32(mask)));
+
+        const __m128 tap0 = interpolate(frames + 2 * first[0], w2);
+        const __m128 tap1 = interpolate(frames + 2 * first[1], w1);
+        const __m128 tap2 = interpolate(frames + 2 * first[2], w0);
+        const __m128 tap3 = interpolate(frames + 2 * first[3], wm1);
+
+        const __m128 taps01 = _mm_movelh_ps(tap0, tap1);
+        const __m128 taps23 = _mm_movelh_ps(tap2, tap3);
+        left = _mm_shuffle_ps(taps01, taps23, _MM_SHUFFLE(2, 0, 2, 0));
+        right = _mm_shuffle_ps(taps01, taps23, _MM_SHUFFLE(3, 1, 3, 1));
+    }
+#endif
+
+private:
+    //==============================================================================
+
+#if STEREODELAY_SSE2
+    // Returns (left, right, -, -) for the four frames from frame onwards.
+    static __m128 interpolate(const float* frame, const __m128 weights)
+    {
+        const __m128 older = _mm_loadu_ps(frame);
+        const __m128 newer = _mm_loadu_ps(frame + 4);
+
+        const __m128 sum = _mm_add_ps(_mm_mul_ps(older, _mm_unpacklo_ps(weights, weights)),
+                                      _mm_mul_ps(newer, _mm_unpackhi_ps(weights, weights)));
+        return _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    }
+#endif
+
+    //==============================================================================
+
+    HeapBlock<float> frames;
+
+    int size = 1;
+    int mask = 0;
+    float maxDelay = 0.0f;
+    int writePosition = 0;
+
+    //==============================================================================
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StereoDelayLine)
+};
+
+//==============================================================================
@@ -0,0 +1,527 @@
+#pragma once
+
+#include <type_traits>
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_USE_SIMD && defined (__SSE2__)
+ #include <emmintrin.h>
+ #define FRACTIONALDELAY_SSE2 1
+#else
+ #define FRACTIONALDELAY_SSE2 0
+#endif
+
+//==============================================================================
+
+/*
+    Interpolation policies for FractionalDelayLine. A delay of d samples is
+    split into whole = floor(d) and fraction = d - whole; a policy reads the
+    samples around position - whole and moves fraction of the way towards
+    the next older one. In order of cost and quality:
+
+    None       nearest sample (truncates the delay), minDelay 1
+    Linear     two samples, minDelay 1
+    Hermite    4-point cubic Hermite (Catmull-Rom), minDelay 2
+    Lagrange3  4-point 3rd-order Lagrange, minDelay 2
+    Thiran     1st-order allpass: flat magnitude, so it suits fixed delays in
+               feedback loops, but it has a state per tap and rings briefly
+               when the delay jumps. minDelay 2
+
+    minDelay is the shortest delay for which every sample read was written
+    before the current one; shorter delays are clamped to it. Each policy has
+    a scalar read and, on SSE2, a read of four taps at once whose samples are
+    gathered with masked indices and interpolated in one vector; the 4-point
+    policies load each tap's four neighbours with one unaligned load and
+    transpose them. The delay line mirrors its first samples past the end of
+    the buffer, so those spans never wrap.
+
+    readBlock() computes consecutive outputs at one constant delay from a
+    contiguous span, span[0] being the oldest sample (position - 2) the
+    first output needs; the span holds numSamples + 3 samples. The FIR
+    policies become a few vector operations over the span.
+*/
+
+struct DelayInterpolation
+{
+    //==============================================================================
+
+    struct None
+    {
+        enum { minDelay = 1 };
+        struct State {};
+
+        static float read(const float* data, const int mask, const int position, const float, State&)
+        {
+            return data[position & mask];
+        }
+
+        static void readBlock(const float* span, const float, State&, float* destination, const int numSamples)
+        {
+            FloatVectorOperations::copy(destination, span + 2, numSamples);
+        }
+
+#if FRACTIONALDELAY_SSE2
+        static __m128 read(const float* data, const int mask, const __m128i position, const __m128, State*)
+        {
+            return gather(data, mask, position);
+        }
+#endif
+    };
+
+    //==============================================================================
+
+    struct Linear
+    {
+        enum { minDelay = 1 };
+        struct State {};
+
+        static float read(const float* data, const int mask, const int position, const float fraction, State&)
+        {
+            const float x0 = data[position & mask];
+            const float x1 = data[(position - 1) & mask];
+            return x0 + fraction * (x1 - x0);
+        }
+
+        static void readBlock(const float* span, const float fraction, State&, float* destination, const int numSamples)
+        {
+            FloatVectorOperations::copyWithMultiply(destination, span + 2, 1.0f - fraction, numSamples);
+            FloatVectorOperations::addWithMultiply(destination, span + 1, fraction, numSamples);
+        }
+
+#if FRACTIONALDELAY_SSE2
+        static __m128 read(const float* data, const int mask, const __m128i position, const __m128 fraction, State*)
+        {
+            const __m128 x0 = gather(data, mask, position);
+            const __m128 x1 = gather(data, mask, _mm_sub_epi32(position, _mm_set1_epi32(1)));
+            return _mm_add_ps(x0, _mm_mul_ps(fraction, _mm_sub_ps(x1, x0)));
+        }
+#endif
+    };
+
+    //==============================================================================
+
+    struct Hermite
+    {
+        enum { minDelay = 2 };
+        struct State {};
+
+        static float read(const float* data, const int mask, const int position, const float t, State&)
+        {
+            const float xm1 = data[(position + 1) & mask];
+            const float x0 = data[position & mask];
+            const float x1 = data[(position - 1) & mask];
+            const float x2 = data[(position - 2) & mask];
+
+            const float c1 = 0.5f * (x1 - xm1);
+            const float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+            const float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+            return ((c3 * t + c2) * t + c1) * t + x0;
+        }
+
+        static void readBlock(const float* span, const float t, State&, float* destination, const int numSamples)
+        {
+            convolve(span, t * t * (0.5f * t - 0.5f), t * (0.5f + t * (2.0f - 1.5f * t)),
+                1.0f + t * t * (1.5f * t - 2.5f), t * (-0.5f + t * (1.0f - 0.5f * t)), destination, numSamples);
+        }
+
+#if FRACTIONALDELAY_SSE2
+        static __m128 read(const float* data, const int mask, const __m128i position, const __m128 t, State*)
+        {
+            __m128 xm1, x0, x1, x2;
+            gatherSpans(data, mask, position, xm1, x0, x1, x2);
+
+            const __m128 half = _mm_set1_ps(0.5f);
+            const __m128 c1 = _mm_mul_ps(half, _mm_sub_ps(x1, xm1));
+            const __m128 c2 = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(xm1, _mm_mul_ps(_mm_set1_ps(2.5f), x0)), _mm_add_ps(x1, x1)),
+                                         _mm_mul_ps(half, x2));
+            const __m128 c3 = _mm_add_ps(_mm_mul_ps(half, _mm_sub_ps(x2, xm1)), _mm_mul_ps(_mm_set1_ps(1.5f), _mm_sub_ps(x0, x1)));
+
+            __m128 y = _mm_add_ps(_mm_mul_ps(c3, t), c2);
+            y = _mm_add_ps(_mm_mul_ps(y, t), c1);
+            return _mm_add_ps(_mm_mul_ps(y, t), x0);
+        }
+#endif
+    };
+
+    //==============================================================================
+
+    struct Lagrange3
+    {
+        enum { minDelay = 2 };
+        struct State {};
+
+        static float read(const float* data, const int mask, const int position, const float t, State&)
+        {
+            const float xm1 = data[(position + 1) & mask];
+            const float x0 = data[position & mask];
+            const float x1 = data[(position - 1) & mask];
+            const float x2 = data[(position - 2) & mask];
+
+            const float tp1 = t + 1.0f;
+            const float tm1 = t - 1.0f;
+            const float tm2 = t - 2.0f;
+            return tm1 * tm2 * (-(1.0f / 6.0f) * t * xm1 + 0.5f * tp1 * x0)
+                 + tp1 * t * (-0.5f * tm2 * x1 + (1.0f / 6.0f) * tm1 * x2);
+        }
+
+        static void readBlock(const float* span, const float t, State&, float* destination, const int numSamples)
+        {
+            const float tp1 = t + 1.0f;
+            const float tm1 = t - 1.0f;
+            const float tm2 = t - 2.0f;
+
+            convolve(span, (1.0f / 6.0f) * tp1 * t * tm1, -0.5f * tp1 * t * tm2,
+                0.5f * tp1 * tm1 * tm2, -(1.0f / 6.0f) * t * tm1 * tm2, destination, numSamples);
+        }
+
+#if FRACTIONALDELAY_SSE2
+        static __m128 read(const float* data, const int mask, const __m128i position, const __m128 t, State*)
+        {
+            __m128 xm1, x0, x1, x2;
+            gatherSpans(data, mask, position, xm1, x0, x1, x2);
+
+            const __m128 half = _mm_set1_ps(0.5f);
+            const __m128 sixth = _mm_set1_ps(1.0f / 6.0f);
+            const __m128 tp1 = _mm_add_ps(t, _mm_set1_ps(1.0f));
+            const __m128 tm1 = _mm_sub_ps(t, _mm_set1_ps(1.0f));
+            const __m128 tm2 = _mm_sub_ps(t, _mm_set1_ps(2.0f));
+
+            const __m128 a = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(half, tp1), x0), _mm_mul_ps(_mm_mul_ps(sixth, t), xm1));
+            const __m128 b = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(sixth, tm1), x2), _mm_mul_ps(_mm_mul_ps(half, tm2), x1));
+            return _mm_add_ps(_mm_mul_ps(_mm_mul_ps(tm1, tm2), a), _mm_mul_ps(_mm_mul_ps(tp1, t), b));
+        }
+#endif
+    };
+
+    //==============================================================================
+
+    // The allpass delays by d in [0.5, 1.5) for a coefficient of (1 - d) / (1 + d),
+    // so fractions below one half borrow a sample from the whole delay.
+    struct Thiran
+    {
+        enum { minDelay = 2 };
+        struct State { float previousOutput; };
+
+        static float read(const float* data, const int mask, int position, float fraction, State& state)
+        {
+            if (fraction < 0.5f) {
+                fraction += 1.0f;
+                position++;
+            }
+
+            const float a = (1.0f - fraction) / (1.0f + fraction);
+            const float output = a * (data[position & mask] - state.previousOutput) + data[(position - 1) & mask];
+            state.previousOutput = output;
+            return output;
+        }
+
+        static void readBlock(const float* span, float fraction, State& state, float* destination, const int numSamples)
+        {
+            const float* x1 = span + 1;
+            if (fraction < 0.5f) {
+                fraction += 1.0f;
+                x1++;
+            }
+
+            const float a = (1.0f - fraction) / (1.0f + fraction);
+            float previousOutput = state.previousOutput;
+            int sample = 0;
+
+#if FRACTIONALDELAY_SSE2
+            // Eight outputs per step. With u = a x0 + x1 the recursion is
+            // y = u - a y[-1]: a prefix scan within each vector, the first
+            // vector's last output carried into the second, then the previous
+            // step's last output times the powers of -a. Only that last
+            // multiply-add waits on the step before.
+            const __m128 a4 = _mm_set1_ps(a);
+            const float b = -a;
+            const __m128 b1 = _mm_set1_ps(b);
+            const __m128 b2 = _mm_set1_ps(b * b);
+            const __m128 powers = _mm_setr_ps(b, b * b, b * b * b, b * b * b * b);
+            const __m128 powers2 = _mm_mul_ps(powers, _mm_set1_ps(b * b * b * b));
+            __m128 carry = _mm_set1_ps(previousOutput);
+
+            for (; sample + 8 <= numSamples; sample += 8) {
+                const __m128 u0 = _mm_add_ps(_mm_mul_ps(a4, _mm_loadu_ps(x1 + sample + 1)), _mm_loadu_ps(x1 + sample));
+                const __m128 u1 = _mm_add_ps(_mm_mul_ps(a4, _mm_loadu_ps(x1 + sample + 5)), _mm_loadu_ps(x1 + sample + 4));
+
+                __m128 y0 = scan(u0, b1, b2);
+                __m128 y1 = scan(u1, b1, b2);
+                y1 = _mm_add_ps(y1, _mm_mul_ps(powers, _mm_shuffle_ps(y0, y0, _MM_SHUFFLE(3, 3, 3, 3))));
+
+                y0 = _mm_add_ps(y0, _mm_mul_ps(powers, carry));
+                y1 = _mm_add_ps(y1, _mm_mul_ps(powers2, carry));
+                _mm_storeu_ps(destination + sample, y0);
+                _mm_storeu_ps(destination + sample + 4, y1);
+                carry = _mm_shuffle_ps(y1, y1, _MM_SHUFFLE(3, 3, 3, 3));
+            }
+
+            previousOutput = _mm_cvtss_f32(carry);
+#endif
+
+            for (; sample < numSamples; ++sample) {
+                previousOutput = a * (x1[sample + 1] - previousOutput) + x1[sample];
+                destination[sample] = previousOutput;
+            }
+
+            state.previousOutput = previousOutput;
+        }
+
+#if FRACTIONALDELAY_SSE2
+        // The recursion y = u + b y[-1] within one vector, from zero.
+        static __m128 scan(__m128 u, const __m128 b1, const __m128 b2)
+        {
+            u = _mm_add_ps(u, _mm_mul_ps(b1, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(u), 4))));
+            return _mm_add_ps(u, _mm_mul_ps(b2, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(u), 8))));
+        }
+#endif
+
+#if FRACTIONALDELAY_SSE2
+        static __m128 read(const float* data, const int mask, __m128i position, __m128 fraction, State* state)
+        {
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 borrow = _mm_cmplt_ps(fraction, _mm_set1_ps(0.5f));
+            fraction = _mm_add_ps(fraction, _mm_and_ps(borrow, one));
+            position = _mm_sub_epi32(position, _mm_castps_si128(borrow));
+
+            const __m128 a = _mm_div_ps(_mm_sub_ps(one, fraction), _mm_add_ps(one, fraction));
+            const __m128 x0 = gather(data, mask, position);
+            const __m128 x1 = gather(data, mask, _mm_sub_epi32(position, _mm_set1_epi32(1)));
+
+            float* previousOutput = &state->previousOutput;
+            const __m128 output = _mm_add_ps(_mm_mul_ps(a, _mm_sub_ps(x0, _mm_loadu_ps(previousOutput))), x1);
+            _mm_storeu_ps(previousOutput, output);
+            return output;
+        }
+#endif
+    };
+
+    //==============================================================================
+
+    // destination[i] = w2 span[i] + w1 span[i + 1] + w0 span[i + 2] + wm1 span[i + 3]
+    static void convolve(const float* span, const float w2, const float w1, const float w0, const float wm1,
+        float* destination, const int numSamples)
+    {
+        FloatVectorOperations::copyWithMultiply(destination, span, w2, numSamples);
+        FloatVectorOperations::addWithMultiply(destination, span + 1, w1, numSamples);
+        FloatVectorOperations::addWithMultiply(destination, span + 2, w0, numSamples);
+        FloatVectorOperations::addWithMultiply(destination, span + 3, wm1, numSamples);
+    }
+
+#if FRACTIONALDELAY_SSE2
+    static __m128 gather(const float* data, const int mask, const __m128i position)
+    {
+        int index[4];
+        _mm_storeu_si128((__m128i*)index, _mm_and_si128(position, _mm_set1_epi32(mask)));
+        return _mm_set_ps(data[index[3]], data[index[2]], data[index[1]], data[index[0]]);
+    }
+
+    // The samples at position + 1 down to position - 2 for every lane. The
+    // buffer must hold mask + 4 samples, the last three mirroring the first.
+    static void gatherSpans(const float* data, const int mask, const __m128i position,
+        __m128& xm1, __m128& x0, __m128& x1, __m128& x2)
+    {
+        int index[4];
+        _mm_storeu_si128((__m128i*)index, _mm_and_si128(_mm_sub_epi32(position, _mm_set1_epi32(2)), _mm_set1_epi32(mask)));
+
+        x2 = _mm_loadu_ps(data + index[0]);
+        x1 = _mm_loadu_ps(data + index[1]);
+        x0 = _mm_loadu_ps(data + index[2]);
+        xm1 = _mm_loadu_ps(data + index[3]);
+        _MM_TRANSPOSE4_PS(x2, x1, x0, xm1);
+    }
+#endif
+};
+
+//==============================================================================
+
+/*
+    Multichannel delay line with a power-of-two length, so positions wrap with
+    a mask and callers can pass any position from getWritePosition() onwards.
+    Samples are read before the current one is written: a delay of d reads
+    the input from d samples ago. Every channel has numTaps read taps, which
+    only matters for policies with a state (Thiran); read4() uses the four
+    taps starting at firstTap. The first numGuardSamples samples are mirrored
+    past the end of the buffer for the 4-point spans.
+*/
+
+template <class Interpolation>
+class FractionalDelayLine
+{
+public:
+    //==============================================================================
+
+    enum {
+        minDelay = Interpolation::minDelay,
+        numGuardSamples = 3,
+    };
+
+    FractionalDelayLine() {}
+
+    //==============================================================================
+
+    void setSize(const int numChannelsToUse, const int maxDelaySamples, const int numTapsToUse = 1)
+    {
+        numChannels = jmax(0, numChannelsToUse);
+        numTaps = jmax(1, numTapsToUse);
+
+        // The interpolators read up to two samples past the whole delay.
+        size = nextPowerOfTwo(jmax(maxDelaySamples, (int)minDelay) + 3);
+        mask = size - 1;
+        maxDelay = (float)(size - 3);
+
+        buffer.setSize(numChannels, size + numGuardSamples);
+        tapStates.allocate((size_t)jmax(1, numChannels * numTaps), true);
+        clear();
+    }
+
+    void clear()
+    {
+        buffer.clear();
+        for (int tap = 0; tap < numChannels * numTaps; tap++)
+            tapStates[tap] = TapState();
+        writePosition = 0;
+    }
+
+    //==============================================================================
+
+    int getSize() const { return size; }
+    int getWritePosition() const { return writePosition; }
+
+    void advance(const int numSamples)
+    {
+        writePosition = (writePosition + numSamples) & mask;
+    }
+
+    //==============================================================================
+
+    void write(const int channel, const int position, const float sample)
+    {
+        float* data = buffer.getWritePointer(channel);
+        const int index = position & mask;
+
+        data[index] = sample;
+        if (index < numGuardSamples)
+            data[index + size] = sample;
+    }
+
+    // write() for the numSamples samples from position on.
+    void writeBlock(const int channel, const int position, const float* source, const int numSamples)
+    {
+        float* data = buffer.getWritePointer(channel);
+        int first = position & mask;
+
+        for (int done = 0; done < numSamples;) {
+            const int count = jmin(numSamples - done, size - first);
+            FloatVectorOperations::copy(data + first, source + done, count);
+            done += count;
+            first = 0;
+        }
+
+        FloatVectorOperations::copy(data + size, data, numGuardSamples);
+    }
+
+    float read(const int channel, const int tap, const int position, float delay)
+    {
+        delay = jlimit((float)minDelay, maxDelay, delay);
+        const int whole = (int)delay;
+
+        return Interpolation::read(buffer.getReadPointer(channel), mask, position - whole, delay - (float)whole,
+            tapStates[channel * numTaps + tap]);
+    }
+
+    // True if numSamples outputs at this delay only read samples written
+    // before the first of them, so readBlock() can run before the block's
+    // writes.
+    bool canReadBlock(const float delay, const int numSamples) const
+    {
+        return (int)jlimit((float)minDelay, maxDelay, delay) > numSamples;
+    }
+
+    // read() for the numSamples positions from position on, at one delay.
+    // Requires canReadBlock(); the span wraps around the buffer end at most
+    // once, into the mirrored samples.
+    void readBlock(const int channel, const int tap, const int position, float delay, float* destination, const int numSamples)
+    {
+        jassert(canReadBlock(delay, numSamples));
+
+        delay = jlimit((float)minDelay, maxDelay, delay);
+        const int whole = (int)delay;
+        const float fraction = delay - (float)whole;
+        const float* data = buffer.getReadPointer(channel);
+        TapState& state = tapStates[channel * numTaps + tap];
+
+        int first = (position - whole - 2) & mask;
+
+        for (int done = 0; done < numSamples;) {
+            const int count = jmin(numSamples - done, size - first);
+            Interpolation::readBlock(data + first, fraction, state, destination + done, count);
+            done += count;
+            first = 0;
+        }
+    }
+
+    // Reads through the policy Other instead, over the same samples, so the
+    // interpolation can change without a second buffer. Its state, if it has
+    // one, is the caller's.
+    template <class Other>
+    float readWith(const int channel, const int position, float delay, typename Other::State& state) const
+    {
+        delay = jlimit((float)jmax((int)minDelay, (int)Other::minDelay), maxDelay, delay);
+        const int whole = (int)delay;
+
+        return Other::read(buffer.getReadPointer(channel), mask, position - whole, delay - (float)whole, state);
+    }
+
+#if FRACTIONALDELAY_SSE2
+    // Reads one tap at the four positions from position on, each with its own
+    // delay, through the stateless policy Other. All four inputs have to be
+    // written first, so the longest delay has to stay three samples shorter
+    // than the line allows.
+    template <class Other>
+    __m128 readConsecutive4(const int channel, const int position, __m128 delay) const
+    {
+        static_assert(std::is_empty<typename Other::State>::value, "a stateful policy cannot read ahead");
+
+        delay = _mm_min_ps(_mm_max_ps(delay, _mm_set1_ps((float)jmax((int)minDelay, (int)Other::minDelay))), _mm_set1_ps(maxDelay));
+        const __m128i whole = _mm_cvttps_epi32(delay);
+        const __m128i positions = _mm_add_epi32(_mm_set1_epi32(position), _mm_setr_epi32(0, 1, 2, 3));
+
+        return Other::read(buffer.getReadPointer(channel), mask, _mm_sub_epi32(positions, whole),
+            _mm_sub_ps(delay, _mm_cvtepi32_ps(whole)), nullptr);
+    }
+
+    __m128 read4(const int channel, const int firstTap, const int position, __m128 delay)
+    {
+        jassert(firstTap + 4 <= numTaps);
+
+        delay = _mm_min_ps(_mm_max_ps(delay, _mm_set1_ps((float)minDelay)), _mm_set1_ps(maxDelay));
+        const __m128i whole = _mm_cvttps_epi32(delay);
+
+        return Interpolation::read(buffer.getReadPointer(channel), mask,
+            _mm_sub_epi32(_mm_set1_epi32(position), whole), _mm_sub_ps(delay, _mm_cvtepi32_ps(whole)),
+            tapStates + channel * numTaps + firstTap);
+    }
+#endif
+
+private:
+    //==============================================================================
+
+    typedef typename Interpolation::State TapState;
+
+    AudioSampleBuffer buffer;
+    HeapBlock<TapState> tapStates;
+
+    int numChannels = 0;
+    int numTaps = 1;
+    int size = 1;
+    int mask = 0;
+    float maxDelay = 0.0f;
+    int writePosition = 0;
+
+    //==============================================================================
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FractionalDelayLine)
+};
+
+//==============================================================================
@@ -33,14 +33,8 @@ void DelayAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
     mixSlider.reset(sampleRate, tiny);
 
     float maxDelay = delayTimeSlider.max;
-    delaySamples = (int)(maxDelay * (float)sampleRate) + 1;
-    if (delaySamples < 1) delaySamples = 1;
-
-    delayBufferChannels = getTotalNumInputChannels();
-    delayBuffer.setSize(delayBufferChannels, delaySamples);
-    delayBuffer.clear();
-
-    delayWritePos = 0;
+    delayLine.setSize(getTotalNumInputChannels(), (int)(maxDelay * (float)sampleRate) + 1);
+    scratchBuffer.setSize(2, jmax(1, samplesPerBlock));
 }
 
 void DelayAudioProcessor::releaseResources()
@@ -59,36 +53,53 @@ void DelayAudioProcessor::processBlock(AudioSampleBuffer& buffer, MidiBuffer& mi
     float currentFB = feedbackSlider.getNextValue();
     float currentDT = delayTimeSlider.getTargetValue() * (float)getSampleRate();
 
-    int writePos;
+    const int writePosition = delayLine.getWritePosition();
 
-    for (int channel = 0; channel < numInputChannels; channel++) {
-        
-        float* channelData = buffer.getWritePointer(channel);
-        float* delayData = delayBuffer.getWritePointer(channel);
-        writePos = delayWritePos;
+    // A delay time of zero leaves the signal and the delay line untouched.
+    if (currentDT > 0.0f) {
 
-        for (int sample = 0; sample < numSamples; sample++) {
+        if (numSamples <= scratchBuffer.getNumSamples() && delayLine.canReadBlock(currentDT, numSamples)) {
 
-            float output = 0.0f;
+            // The delay is longer than the block, so the block only reads
+            // what was written before it: the reads, the mix and the feedback
+            // each run over whole vectors.
+            float* delayed = scratchBuffer.getWritePointer(0);
+            float* feedback = scratchBuffer.getWritePointer(1);
 
-            float currReadPos = fmodf((float)writePos - currentDT + (float)delaySamples, delaySamples);
-            int readPos = floorf(currReadPos);
+            for (int channel = 0; channel < numInputChannels; channel++) {
 
-            if (readPos != writePos) {
+                float* channelData = buffer.getWritePointer(channel);
 
-                output = delayData[(readPos + 0)] + (currReadPos - (float)readPos) * ((delayData[(readPos + 1) % delaySamples]) - (delayData[(readPos + 0)]));
+                delayLine.readBlock(channel, 0, writePosition, currentDT, delayed, numSamples);
 
-                channelData[sample] = channelData[sample] + (currentMix * (output - channelData[sample]));
-                delayData[writePos] = channelData[sample] + (output * currentFB);
+                FloatVectorOperations::copy(feedback, channelData, numSamples);
+                FloatVectorOperations::addWithMultiply(feedback, delayed, currentFB, numSamples);
+                delayLine.writeBlock(channel, writePosition, feedback, numSamples);
+
+                FloatVectorOperations::multiply(channelData, 1.0f - currentMix, numSamples);
+                FloatVectorOperations::addWithMultiply(channelData, delayed, currentMix, numSamples);
             }
+        }
+        else {
 
-            writePos++;
+            for (int channel = 0; channel < numInputChannels; channel++) {
 
-            if (writePos >= delaySamples) writePos -= delaySamples;
+                float* channelData = buffer.getWritePointer(channel);
+
+                for (int sample = 0; sample < numSamples; sample++) {
+
+                    const int position = writePosition + sample;
+                    const float input = channelData[sample];
+                    const float output = delayLine.read(channel, 0, position, currentDT);
+
+                    channelData[sample] = input + (currentMix * (output - input));
+                    delayLine.write(channel, position, input + (output * currentFB));
+                }
+            }
         }
     }
 
-    delayWritePos = writePos;
+    delayLine.advance(numSamples);
 
     //======================================
 
@@ -5,6 +5,7 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "PluginParameter.h"
+#include "FractionalDelayLine.h"
 
 //==============================================================================
 
@@ -71,10 +72,8 @@ public:
 
     //==============================================================================
 
-    AudioSampleBuffer delayBuffer;
-    int delaySamples;
-    int delayBufferChannels;
-    int delayWritePos;
+    FractionalDelayLine<DelayInterpolation::Thiran> delayLine;
+    AudioSampleBuffer scratchBuffer;
 
     //======================================
 
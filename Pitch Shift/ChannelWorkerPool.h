@@ -0,0 +1,173 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/*
+    Small fixed pool of worker threads for running independent per-channel jobs
+    from the audio thread. Threads are created in prepare(), never while audio
+    is running. run() publishes the job, wakes the workers, works through the
+    jobs itself as well and spins until every job has finished, so the caller
+    always returns with all channels done and no allocation or blocking wait
+    on the audio thread. Between runs the job index is parked far past any job
+    count, so a worker that wakes late claims nothing.
+
+    The workers run at the priority passed to prepare(). At realtime audio
+    priority the join spins: a job a worker has claimed cannot be taken back,
+    so the caller waits for it however long the worker takes, which the
+    priority keeps as short as the job itself; if the system preempts a
+    worker anyway, the audio thread spins until it is rescheduled. At any
+    other priority, as for offline rendering, the caller blocks on an event
+    instead, so a long job does not keep a core busy spinning.
+*/
+
+class ChannelWorkerPool
+{
+public:
+    //==============================================================================
+
+    class Job
+    {
+    public:
+        virtual ~Job() {}
+        virtual void runJob(int index) = 0;
+    };
+
+    //==============================================================================
+
+    ChannelWorkerPool()
+    {
+    }
+
+    ~ChannelWorkerPool()
+    {
+        workers.clear();
+    }
+
+    //==============================================================================
+
+    enum {
+        normalPriority = 5,
+    };
+
+    void prepare(const int maxParallelJobs, const int priority)
+    {
+        const int numWorkers = jlimit(0, SystemStats::getNumCpus() - 1, maxParallelJobs - 1);
+
+        if (numWorkers == workers.size() && priority == workerPriority)
+            return;
+
+        workers.clear();
+        workerPriority = priority;
+        spinningJoin = priority == Thread::realtimeAudioPriority;
+
+        for (int index = 0; index < numWorkers; index++) {
+            workers.add(new Worker(*this));
+            workers.getLast()->startThread(priority);
+        }
+    }
+
+    int getNumWorkers() const { return workers.size(); }
+
+    //==============================================================================
+
+    void run(Job& job, const int numJobs)
+    {
+        if (numJobs <= 1 || workers.size() == 0) {
+            for (int index = 0; index < numJobs; index++)
+                job.runJob(index);
+            return;
+        }
+
+        currentJob.store(&job);
+        totalJobs.store(numJobs);
+        finishedJobs.store(0);
+        nextJobIndex.store(0);
+
+        for (int index = 0; index < jmin(workers.size(), numJobs - 1); index++)
+            workers[index]->notify();
+
+        runAvailableJobs();
+
+        if (spinningJoin) {
+            while (finishedJobs.load() < numJobs)
+                Thread::yield();
+        }
+        else {
+            jobsFinished.wait(-1);
+        }
+
+        nextJobIndex.store(closedJobIndex);
+    }
+
+private:
+    //==============================================================================
+
+    class Worker : public Thread
+    {
+    public:
+        Worker(ChannelWorkerPool& owner)
+            : Thread("Pitch Shift Worker")
+            , owner(owner)
+        {
+        }
+
+        ~Worker()
+        {
+            stopThread(1000);
+        }
+
+        void run() override
+        {
+            while (! threadShouldExit()) {
+                wait(-1);
+
+                if (! threadShouldExit())
+                    owner.runAvailableJobs();
+            }
+        }
+
+    private:
+        ChannelWorkerPool& owner;
+    };
+
+    //==============================================================================
+
+    void runAvailableJobs()
+    {
+        for (;;) {
+            const int index = nextJobIndex.fetch_add(1);
+            if (index >= totalJobs.load())
+                break;
+
+            currentJob.load()->runJob(index);
+
+            if (finishedJobs.fetch_add(1) + 1 == totalJobs.load() && ! spinningJoin)
+                jobsFinished.signal();
+        }
+    }
+
+    //==============================================================================
+
+    enum {
+        closedJobIndex = 1 << 30,
+    };
+
+    OwnedArray<Worker> workers;
+
+    std::atomic<Job*> currentJob { nullptr };
+    std::atomic<int> totalJobs { 0 };
+    std::atomic<int> nextJobIndex { closedJobIndex };
+    std::atomic<int> finishedJobs { 0 };
+
+    int workerPriority = normalPriority;
+    bool spinningJoin = false;
+    WaitableEvent jobsFinished;
+
+    //==============================================================================
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ChannelWorkerPool)
+};
+
+//==============================================================================
@@ -0,0 +1,135 @@
+#include "PluginProcessor.h"
+
+#if JUCE_UNIT_TESTS
+
+//==============================================================================
+
+/*
+    Feeds an impulse through the processor and checks that it comes out
+    exactly getLatencySamples() later: for every FFT size and overlap of the
+    phase vocoder and for the low-latency engine, at no shift, where the
+    impulse response peaks on its centre. Then switches the FFT size while
+    playing, delivering the processor's async updates after every block as
+    the message thread would, and checks that the reported latency only
+    changes during the switch and matches the measured delay after it.
+*/
+
+class PitchShiftLatencyTest : public UnitTest
+{
+public:
+    PitchShiftLatencyTest() : UnitTest("Pitch Shift latency", "Pitch Shift") {}
+
+    void runTest() override
+    {
+        beginTest("Impulse delay matches the reported latency");
+
+        for (int fftSize = PitchShiftAudioProcessor::fftSize32; fftSize <= PitchShiftAudioProcessor::fftSize8192; fftSize++) {
+            for (int hopSize = PitchShiftAudioProcessor::hopSize2; hopSize <= PitchShiftAudioProcessor::hopSize8; hopSize++) {
+                PitchShiftAudioProcessor processor;
+                processor.fftSizeCB.updateValue((float)fftSize);
+                processor.hopSizeCB.updateValue((float)hopSize);
+                prepare(processor);
+
+                expectEquals(measureDelay(processor), processor.getLatencySamples(),
+                    "FFT " + String(32 << fftSize) + ", hop 1/" + String(2 << hopSize));
+            }
+        }
+
+        {
+            PitchShiftAudioProcessor processor;
+            processor.engineCB->updateValue((float)PitchShiftAudioProcessor::engineLowLatency);
+            prepare(processor);
+
+            expectEquals(measureDelay(processor), processor.getLatencySamples(), "Low latency engine");
+        }
+
+        beginTest("Reported latency follows an engine switch");
+
+        PitchShiftAudioProcessor processor;
+        processor.fftSizeCB.updateValue((float)PitchShiftAudioProcessor::fftSize512);
+        prepare(processor);
+
+        // Longer, then shorter again: the two ways round the switch aligns.
+        for (const int fftSize : { (int)PitchShiftAudioProcessor::fftSize8192, (int)PitchShiftAudioProcessor::fftSize512 }) {
+            const int oldLatency = processor.getLatencySamples();
+
+            processor.fftSizeCB.updateValue((float)fftSize);
+            processor.handleAsyncUpdate();
+            expectEquals(processor.getLatencySamples(), oldLatency, "Latency reported when the engine is published");
+
+            int numChanges = 0;
+            int latency = oldLatency;
+
+            for (int block = 0; block < 2 * sampleRate / blockSize; block++) {
+                processSilence(processor);
+                processor.handleAsyncUpdate();
+
+                if (processor.getLatencySamples() != latency) {
+                    latency = processor.getLatencySamples();
+                    numChanges++;
+                }
+            }
+
+            expectEquals(numChanges, 1, "Latency changes during the switch");
+            expectEquals(measureDelay(processor), processor.getLatencySamples(), "FFT " + String(32 << fftSize));
+        }
+    }
+
+private:
+    //==============================================================================
+
+    enum {
+        sampleRate = 48000,
+        blockSize = 128,
+        impulseOffset = 17,
+    };
+
+    static void prepare(PitchShiftAudioProcessor& processor)
+    {
+        processor.setPlayConfigDetails(1, 1, sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+    }
+
+    static void processSilence(PitchShiftAudioProcessor& processor)
+    {
+        AudioSampleBuffer buffer(1, blockSize);
+        MidiBuffer midiMessages;
+
+        buffer.clear();
+        processor.processBlock(buffer, midiMessages);
+    }
+
+    // Feeds an impulse into otherwise silent blocks and returns the delay to
+    // the largest output sample.
+    static int measureDelay(PitchShiftAudioProcessor& processor)
+    {
+        AudioSampleBuffer buffer(1, blockSize);
+        MidiBuffer midiMessages;
+
+        const int numSamples = impulseOffset + processor.getLatencySamples() + 2 * blockSize;
+        int peakPosition = -1;
+        float peak = 0.0f;
+
+        for (int start = 0; start < numSamples; start += blockSize) {
+            buffer.clear();
+            if (start == 0)
+                buffer.setSample(0, impulseOffset, 1.0f);
+
+            processor.processBlock(buffer, midiMessages);
+
+            for (int sample = 0; sample < blockSize; sample++) {
+                const float magnitude = std::abs(buffer.getSample(0, sample));
+                if (magnitude > peak) {
+                    peak = magnitude;
+                    peakPosition = start + sample;
+                }
+            }
+        }
+
+        return peakPosition - impulseOffset;
+    }
+};
+
+static PitchShiftLatencyTest pitchShiftLatencyTest;
+
+#endif
@@ -0,0 +1,453 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "PhaseVocoder.h"
+#include "ChannelWorkerPool.h"
+
+//==============================================================================
+
+/*
+    Renders a whole buffer or file through the pitch shifter on every core,
+    with the same result as streaming it through one engine.
+
+    The stream is cut into segments that are rendered in parallel, each by
+    its own engine. A segment starts from silence a preroll earlier than its
+    first output sample, longer than any frame keeps contributing to the
+    output, so only the phase vocoder's accumulated output phase is missing
+    at its start. That phase is a running sum over every frame before it,
+    so it is found in two parallel passes: the first only analyses each
+    segment and records how far its frames advance the output phase, both
+    over the whole segment and up to where the next segment's preroll
+    starts; a serial scan then adds those advances up into the phase every
+    preroll has to start from, and the second pass renders. Before either
+    pass an engine is fed one frame and one hop of earlier input, so its
+    input ring and the phase of the previous frame are exactly the
+    streaming ones. The only difference from streaming is the rounding of
+    the phase sums, which are wrapped per segment instead of per frame.
+
+    Files are streamed a wave of segments at a time, so memory stays
+    bounded for hour-long stems. The time-domain engine's splice points
+    depend on the whole history, so it is rendered serially, as is
+    everything when there is only one thread.
+*/
+
+class OfflineRenderer : private ChannelWorkerPool::Job
+{
+public:
+    //==============================================================================
+
+    struct Settings
+    {
+        int engine = PhaseVocoder::enginePhaseVocoder;
+        int fftSize = 512;
+        int overlap = 8;
+        int windowType = WindowTables::windowTypeHann;
+        int resamplerQuality = PolyphaseResampler::qualitySinc8;
+        int grainSize = 128;
+        float minRatio = 0.5f;
+
+        int numVoices = 1;
+        float pitchShifts[PhaseVocoder::maxVoices] = { 1.0f };
+        float gains[PhaseVocoder::maxVoices] = { 1.0f };
+
+        // Drops the latency from the start of the output and renders the
+        // tail it pushes past the end instead.
+        bool compensateLatency = true;
+    };
+
+    typedef std::function<void(AudioSampleBuffer& destination, int64 inputStart, int numSamples)> ReadFunction;
+    typedef std::function<void(const AudioSampleBuffer& source, int sourceStart, int64 outputStart, int numSamples)> WriteFunction;
+
+    //==============================================================================
+
+    OfflineRenderer(const Settings& settingsToUse, const int numThreads = SystemStats::getNumCpus())
+        : settings(settingsToUse)
+    {
+        settings.numVoices = jlimit(1, (int)PhaseVocoder::maxVoices, settings.numVoices);
+        workerPool.prepare(numThreads, ChannelWorkerPool::normalPriority);
+    }
+
+    //==============================================================================
+
+    // The output must have the input's channels and at least its length.
+    void render(const AudioSampleBuffer& input, AudioSampleBuffer& output)
+    {
+        jassert(output.getNumChannels() == input.getNumChannels());
+        jassert(output.getNumSamples() >= input.getNumSamples());
+
+        render(input.getNumChannels(), input.getNumSamples(),
+            [&input](AudioSampleBuffer& destination, const int64 inputStart, const int numSamples) {
+                for (int channel = 0; channel < input.getNumChannels(); channel++)
+                    destination.copyFrom(channel, 0, input, channel, (int)inputStart, numSamples);
+            },
+            [&output](const AudioSampleBuffer& source, const int sourceStart, const int64 outputStart, const int numSamples) {
+                for (int channel = 0; channel < output.getNumChannels(); channel++)
+                    output.copyFrom(channel, (int)outputStart, source, channel, sourceStart, numSamples);
+            });
+    }
+
+    // Writes a 32-bit float WAV file with the input's channels and rate.
+    bool renderFile(const File& inputFile, const File& outputFile)
+    {
+        AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        std::unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(inputFile));
+        if (reader == nullptr)
+            return false;
+
+        outputFile.deleteFile();
+        std::unique_ptr<FileOutputStream> stream(outputFile.createOutputStream());
+        if (stream == nullptr)
+            return false;
+
+        WavAudioFormat wavFormat;
+        std::unique_ptr<AudioFormatWriter> writer(wavFormat.createWriterFor(stream.get(),
+            reader->sampleRate, reader->numChannels, 32, {}, 0));
+        if (writer == nullptr)
+            return false;
+
+        stream.release();
+        bool success = true;
+
+        render((int)reader->numChannels, reader->lengthInSamples,
+            [&reader](AudioSampleBuffer& destination, const int64 inputStart, const int numSamples) {
+                reader->read(&destination, 0, numSamples, inputStart, true, true);
+            },
+            [&writer, &success](const AudioSampleBuffer& source, const int sourceStart, const int64, const int numSamples) {
+                success = writer->writeFromAudioSampleBuffer(source, sourceStart, numSamples) && success;
+            });
+
+        return success;
+    }
+
+    // Reads the input in order of increasing start and writes the output in
+    // order, each sample once.
+    void render(const int numChannelsToRender, const int64 numInputSamplesToRender,
+        const ReadFunction& readInput, const WriteFunction& writeOutput)
+    {
+        numChannels = numChannelsToRender;
+        numInputSamples = numInputSamplesToRender;
+        readFunction = &readInput;
+        writeFunction = &writeOutput;
+
+        vocoders.clear();
+        freeVocoders.clear();
+
+        PhaseVocoder* probe = acquireVocoder();
+        hopSize = probe->getHopSize();
+        numBins = probe->getNumBins();
+        latency = settings.compensateLatency ? probe->getLatencySamples() : 0;
+        warmupLength = probe->getFftSize() + hopSize;
+        prerollLength = (int)roundUp(probe->getTailLengthSamples() + probe->getFftSize(), hopSize);
+
+        const int64 totalLength = numInputSamples + latency;
+
+        // Seeding costs about half a pass of extra analysis, which only pays
+        // off with more than one thread.
+        if (probe->isTimeDomain() || workerPool.getNumWorkers() == 0) {
+            renderSerially(*probe, totalLength);
+            return;
+        }
+
+        releaseVocoder(probe);
+
+        const int maxParallelSegments = workerPool.getNumWorkers() + 1;
+        segmentLength = (int)roundUp(jmax((int64)segmentsPerPreroll * prerollLength,
+            jmin((int64)maxSegmentLength, totalLength / (segmentsPerThread * maxParallelSegments))), hopSize);
+        numSegments = (int)((totalLength + segmentLength - 1) / segmentLength);
+
+        const int segmentsPerWave = segmentsPerThread * maxParallelSegments;
+        const int numPhaseChannels = numChannels * settings.numVoices;
+
+        segments.clear();
+        for (int index = 0; index < jmin(segmentsPerWave, numSegments); index++) {
+            Segment* segment = segments.add(new Segment());
+            segment->phaseAdvance.setSize(numPhaseChannels, numBins);
+            segment->checkpointAdvance.setSize(numPhaseChannels, numBins);
+            segment->seedPhase.setSize(numPhaseChannels, numBins);
+        }
+
+        startPhase.setSize(numPhaseChannels, numBins);
+        startPhase.clear();
+        nextSeedPhase.setSize(numPhaseChannels, numBins);
+        nextSeedPhase.clear();
+
+        for (firstSegment = 0; firstSegment < numSegments; firstSegment += segmentsPerWave) {
+            const int numWaveSegments = jmin(segmentsPerWave, numSegments - firstSegment);
+
+            for (int index = 0; index < numWaveSegments; index++) {
+                segments[index]->start = (int64)(firstSegment + index) * segmentLength;
+                segments[index]->end = jmin(totalLength, segments[index]->start + segmentLength);
+            }
+
+            waveStart = jmax((int64)0, segments[0]->start - prerollLength - warmupLength);
+            outputStart = segments[0]->start;
+            const int64 waveEnd = segments[numWaveSegments - 1]->end;
+
+            inputWindow.setSize(numChannels, (int)(waveEnd - waveStart), false, false, true);
+            readStream(inputWindow, waveStart, (int)(waveEnd - waveStart));
+            outputWindow.setSize(numChannels, (int)(waveEnd - outputStart), false, false, true);
+            outputChannels = outputWindow.getArrayOfWritePointers();
+
+            currentPass = passAnalyse;
+            workerPool.run(*this, numWaveSegments);
+
+            for (int index = 0; index < numWaveSegments; index++) {
+                Segment& segment = *segments[index];
+                segment.seedPhase.makeCopyOf(nextSeedPhase, true);
+                addPhases(nextSeedPhase, startPhase, segment.checkpointAdvance);
+                addPhases(startPhase, startPhase, segment.phaseAdvance);
+            }
+
+            currentPass = passRender;
+            workerPool.run(*this, numWaveSegments);
+
+            writeStream(outputWindow, outputStart, (int)(waveEnd - outputStart));
+        }
+    }
+
+private:
+    //==============================================================================
+
+    struct Segment
+    {
+        int64 start = 0;
+        int64 end = 0;
+
+        AudioSampleBuffer phaseAdvance;
+        AudioSampleBuffer checkpointAdvance;
+        AudioSampleBuffer seedPhase;
+    };
+
+    enum {
+        passAnalyse = 0,
+        passRender,
+    };
+
+    enum {
+        segmentsPerThread = 4,
+        segmentsPerPreroll = 8,
+        maxSegmentLength = 1 << 18,
+    };
+
+    //==============================================================================
+
+    void runJob(const int index) override
+    {
+        Segment& segment = *segments[index];
+        const bool firstInStream = firstSegment + index == 0;
+        const bool lastInStream = firstSegment + index == numSegments - 1;
+
+        // The last segment's advance would only seed a segment after it.
+        if (currentPass == passAnalyse && lastInStream)
+            return;
+
+        PhaseVocoder* vocoder = acquireVocoder();
+        ChannelWorkerPool serialPool;
+
+        if (currentPass == passAnalyse) {
+            const int64 checkpoint = segment.end - prerollLength;
+
+            analyseRange(*vocoder, serialPool, jmax((int64)0, segment.start - warmupLength), segment.start);
+            for (int channel = 0; channel < segment.phaseAdvance.getNumChannels(); channel++)
+                FloatVectorOperations::clear(getOutputPhase(*vocoder, channel), numBins);
+
+            analyseRange(*vocoder, serialPool, segment.start, checkpoint);
+            copyPhases(segment.checkpointAdvance, *vocoder);
+
+            analyseRange(*vocoder, serialPool, checkpoint, segment.end);
+            copyPhases(segment.phaseAdvance, *vocoder);
+        }
+        else {
+            if (! firstInStream) {
+                const int64 prerollStart = segment.start - prerollLength;
+                analyseRange(*vocoder, serialPool, jmax((int64)0, prerollStart - warmupLength), prerollStart);
+
+                for (int channel = 0; channel < segment.seedPhase.getNumChannels(); channel++)
+                    FloatVectorOperations::copy(getOutputPhase(*vocoder, channel), segment.seedPhase.getReadPointer(channel), numBins);
+
+                AudioSampleBuffer preroll(numChannels, prerollLength);
+                for (int channel = 0; channel < numChannels; channel++)
+                    preroll.copyFrom(channel, 0, inputWindow, channel, (int)(prerollStart - waveStart), prerollLength);
+
+                vocoder->process(serialPool, preroll.getArrayOfWritePointers(), numChannels, prerollLength,
+                    settings.pitchShifts, settings.gains, settings.numVoices);
+            }
+
+            const int length = (int)(segment.end - segment.start);
+            const int outputOffset = (int)(segment.start - outputStart);
+
+            // Segments write disjoint parts of the output window through raw
+            // pointers, since the buffer's own accessors update shared state.
+            HeapBlock<float*> channels(numChannels);
+            for (int channel = 0; channel < numChannels; channel++) {
+                channels[channel] = outputChannels[channel] + outputOffset;
+                FloatVectorOperations::copy(channels[channel], inputWindow.getReadPointer(channel, (int)(segment.start - waveStart)), length);
+            }
+
+            vocoder->process(serialPool, channels, numChannels, length,
+                settings.pitchShifts, settings.gains, settings.numVoices);
+        }
+
+        releaseVocoder(vocoder);
+    }
+
+    void renderSerially(PhaseVocoder& vocoder, const int64 totalLength)
+    {
+        ChannelWorkerPool serialPool;
+        AudioSampleBuffer chunk(numChannels, maxSegmentLength);
+
+        for (int64 start = 0; start < totalLength; start += maxSegmentLength) {
+            const int length = (int)jmin((int64)maxSegmentLength, totalLength - start);
+
+            readStream(chunk, start, length);
+            vocoder.process(serialPool, chunk.getArrayOfWritePointers(), numChannels, length,
+                settings.pitchShifts, settings.gains, settings.numVoices);
+            writeStream(chunk, start, length);
+        }
+    }
+
+    //==============================================================================
+
+    // Engines are kept for the next segment: setting the configuration again
+    // clears all of their state, which is much cheaper than building the
+    // FFTs and buffers of a new one.
+    PhaseVocoder* acquireVocoder()
+    {
+        PhaseVocoder* vocoder = nullptr;
+        {
+            const ScopedLock sl(vocoderLock);
+
+            if (freeVocoders.size() > 0)
+                vocoder = freeVocoders.removeAndReturn(freeVocoders.size() - 1);
+        }
+
+        if (vocoder == nullptr) {
+            vocoder = new PhaseVocoder();
+            vocoder->prepare(numChannels, settings.minRatio, settings.grainSize);
+
+            const ScopedLock sl(vocoderLock);
+            vocoders.add(vocoder);
+        }
+
+        vocoder->setConfiguration(settings.engine,
+            settings.fftSize,
+            settings.overlap,
+            settings.windowType,
+            settings.resamplerQuality);
+
+        return vocoder;
+    }
+
+    void releaseVocoder(PhaseVocoder* vocoder)
+    {
+        const ScopedLock sl(vocoderLock);
+        freeVocoders.add(vocoder);
+    }
+
+    void analyseRange(PhaseVocoder& vocoder, ChannelWorkerPool& serialPool, const int64 start, const int64 end) const
+    {
+        if (end <= start)
+            return;
+
+        HeapBlock<const float*> channels(numChannels);
+        for (int channel = 0; channel < numChannels; channel++)
+            channels[channel] = inputWindow.getReadPointer(channel, (int)(start - waveStart));
+
+        vocoder.analyse(serialPool, channels, numChannels, (int)(end - start), settings.pitchShifts, settings.numVoices);
+    }
+
+    float* getOutputPhase(PhaseVocoder& vocoder, const int phaseChannel) const
+    {
+        return vocoder.getOutputPhase(phaseChannel / settings.numVoices, phaseChannel % settings.numVoices);
+    }
+
+    void copyPhases(AudioSampleBuffer& destination, PhaseVocoder& vocoder) const
+    {
+        for (int channel = 0; channel < destination.getNumChannels(); channel++)
+            FloatVectorOperations::copy(destination.getWritePointer(channel), getOutputPhase(vocoder, channel), numBins);
+    }
+
+    void addPhases(AudioSampleBuffer& destination, const AudioSampleBuffer& phase, const AudioSampleBuffer& advance) const
+    {
+        for (int channel = 0; channel < destination.getNumChannels(); channel++) {
+            float* destinationData = destination.getWritePointer(channel);
+            const float* phaseData = phase.getReadPointer(channel);
+            const float* advanceData = advance.getReadPointer(channel);
+
+            for (int bin = 0; bin < numBins; bin++)
+                destinationData[bin] = VocoderKernel::wrapPhase(phaseData[bin] + advanceData[bin]);
+        }
+    }
+
+    //==============================================================================
+
+    // Stream sample t is input sample t, silence past the end of the input.
+    void readStream(AudioSampleBuffer& destination, const int64 start, const int numSamples) const
+    {
+        const int numRead = (int)jlimit((int64)0, (int64)numSamples, numInputSamples - start);
+
+        if (numRead > 0)
+            (*readFunction)(destination, start, numRead);
+
+        for (int channel = 0; channel < numChannels; channel++)
+            destination.clear(channel, numRead, numSamples - numRead);
+    }
+
+    // Stream sample t is output sample t - latency.
+    void writeStream(const AudioSampleBuffer& source, const int64 start, const int numSamples) const
+    {
+        const int64 first = jmax(start, (int64)latency);
+        const int64 last = jmin(start + numSamples, numInputSamples + latency);
+
+        if (last > first)
+            (*writeFunction)(source, (int)(first - start), first - latency, (int)(last - first));
+    }
+
+    static int64 roundUp(const int64 value, const int64 multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    //==============================================================================
+
+    Settings settings;
+    ChannelWorkerPool workerPool;
+
+    CriticalSection vocoderLock;
+    OwnedArray<PhaseVocoder> vocoders;
+    Array<PhaseVocoder*> freeVocoders;
+
+    const ReadFunction* readFunction = nullptr;
+    const WriteFunction* writeFunction = nullptr;
+
+    int numChannels = 0;
+    int64 numInputSamples = 0;
+    int hopSize = 0;
+    int numBins = 0;
+    int latency = 0;
+    int warmupLength = 0;
+    int prerollLength = 0;
+
+    int segmentLength = 0;
+    int numSegments = 0;
+    int firstSegment = 0;
+    int currentPass = passAnalyse;
+
+    OwnedArray<Segment> segments;
+    AudioSampleBuffer startPhase;
+    AudioSampleBuffer nextSeedPhase;
+
+    int64 waveStart = 0;
+    int64 outputStart = 0;
+    AudioSampleBuffer inputWindow;
+    AudioSampleBuffer outputWindow;
+    float* const* outputChannels = nullptr;
+
+    //==============================================================================
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OfflineRenderer)
+};
+
+//==============================================================================
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/*
+    Moves the vocoder work off the host's audio thread. The audio thread only
+    pushes each block's input into a lock-free single-producer/single-consumer
+    FIFO, wakes the worker and pulls the same number of finished samples from
+    a second FIFO. The worker drains the input FIFO through the client in
+    chunks and pushes the results back.
+
+    The output FIFO is primed with enough silence that the worker has a full
+    hop to finish a frame after the block that completed it arrives, so the
+    extra latency is one hop plus one host block (the output of a block is
+    due before the worker has seen that block). When the worker is late the
+    missing samples are replaced by silence, counted as a missed deadline and
+    skipped once they do arrive, which keeps the latency constant.
+
+    Only one thread may run the client at a time, and the audio thread never
+    waits for the worker: disable() only asks it to stop after its current
+    chunk and returns true once it has. Until then the audio thread keeps
+    calling process(), which serves whatever output is ready and fills the
+    rest with silence, and only afterwards runs the client itself.
+*/
+
+class OffloadWorker : private Thread
+{
+public:
+    //==============================================================================
+
+    class Client
+    {
+    public:
+        virtual ~Client() {}
+        virtual void processOffloaded(float* const* channels, int numChannels, int numSamples) = 0;
+    };
+
+    //==============================================================================
+
+    OffloadWorker(Client& client)
+        : Thread("Pitch Shift Offload")
+        , client(client)
+    {
+    }
+
+    ~OffloadWorker()
+    {
+        release();
+    }
+
+    //==============================================================================
+
+    void prepare(const int numChannelsToUse, const int maxBlockSize, const int maxLatency)
+    {
+        stopThread(1000);
+
+        numChannels = numChannelsToUse;
+        chunkSize = jmax(1, maxBlockSize);
+
+        const int capacity = 2 * (maxBlockSize + maxLatency) + 1;
+        inputFifo.setTotalSize(capacity);
+        outputFifo.setTotalSize(capacity);
+        inputBuffer.setSize(numChannels, capacity);
+        outputBuffer.setSize(numChannels, capacity);
+        chunkBuffer.setSize(numChannels, chunkSize);
+
+        state.store(stateDisabled);
+        stopRequested.store(false);
+        numMissedDeadlines.store(0);
+        numMissedSamples.store(0);
+
+        startThread(9);
+    }
+
+    //==============================================================================
+
+    // Stops and joins the worker thread; the client is free afterwards.
+    // prepare() starts it again.
+    void release()
+    {
+        stopThread(1000);
+        state.store(stateDisabled);
+        stopRequested.store(false);
+    }
+
+    //==============================================================================
+
+    // Audio thread, only while disabled. Clears both FIFOs, primes the output
+    // with the given latency and hands the client to the worker.
+    void enable(const int latencySamples)
+    {
+        inputFifo.reset();
+        outputFifo.reset();
+        currentLatency = 0;
+        pendingSilence = 0;
+        pendingSkip = 0;
+        setLatency(latencySamples);
+        stopRequested.store(false);
+        state.store(stateIdle);
+    }
+
+    // Audio thread, never waits. Asks the worker to stop and returns true
+    // once it is idle and will not run the client again; call it every block
+    // until then.
+    bool disable()
+    {
+        stopRequested.store(true);
+
+        int expected = stateIdle;
+        state.compare_exchange_strong(expected, stateDisabled);
+        return state.load() == stateDisabled;
+    }
+
+    bool isDisabling() const { return stopRequested.load(); }
+
+    // Audio thread. Moves the latency by inserting silence or skipping output.
+    void setLatency(const int latencySamples)
+    {
+        const int difference = latencySamples - currentLatency;
+        currentLatency = latencySamples;
+
+        if (difference > 0)
+            pendingSilence += difference;
+        else
+            pendingSkip -= difference;
+    }
+
+    // Audio thread.
+    void process(float* const* channels, const int numChannelsToProcess, const int numSamples)
+    {
+        const int channelsUsed = jmin(numChannelsToProcess, numChannels);
+
+        // While stopping, the gaps are expected and not counted.
+        const bool stopping = stopRequested.load();
+
+        if (inputFifo.getFreeSpace() >= numSamples) {
+            writeFifo(inputFifo, inputBuffer, channels, channelsUsed, numSamples);
+        }
+        else {
+            // The worker is so far behind that the input has nowhere to go;
+            // this block will never come back, so stand in silence for it.
+            pendingSilence += numSamples;
+            if (! stopping) {
+                numMissedDeadlines.fetch_add(1);
+                numMissedSamples.fetch_add(numSamples);
+            }
+        }
+
+        notify();
+
+        const int numSkipped = jmin(pendingSkip, outputFifo.getNumReady());
+        skipFifo(outputFifo, numSkipped);
+        pendingSkip -= numSkipped;
+
+        const int numSilent = jmin(pendingSilence, numSamples);
+        pendingSilence -= numSilent;
+
+        const int numRead = pendingSkip > 0 ? 0 : jmin(numSamples - numSilent, outputFifo.getNumReady());
+        const int numMissing = numSamples - numSilent - numRead;
+
+        for (int channel = 0; channel < channelsUsed; channel++)
+            FloatVectorOperations::clear(channels[channel], numSilent);
+
+        if (numRead > 0)
+            readFifo(outputFifo, outputBuffer, channels, channelsUsed, numSilent, numRead);
+
+        if (numMissing > 0) {
+            for (int channel = 0; channel < channelsUsed; channel++)
+                FloatVectorOperations::clear(channels[channel] + numSamples - numMissing, numMissing);
+
+            pendingSkip += numMissing;
+            if (! stopping) {
+                numMissedDeadlines.fetch_add(1);
+                numMissedSamples.fetch_add(numMissing);
+            }
+        }
+    }
+
+    //==============================================================================
+
+    int getNumMissedDeadlines() const { return numMissedDeadlines.load(); }
+    int getNumMissedSamples() const { return numMissedSamples.load(); }
+
+private:
+    //==============================================================================
+
+    void run() override
+    {
+        while (! threadShouldExit()) {
+            wait(-1);
+
+            int expected = stateIdle;
+            if (threadShouldExit() || ! state.compare_exchange_strong(expected, stateBusy))
+                continue;
+
+            // A stop request ends the pass after the current chunk.
+            while (! stopRequested.load()) {
+                const int numSamples = jmin(chunkSize, inputFifo.getNumReady(), outputFifo.getFreeSpace());
+                if (numSamples <= 0)
+                    break;
+
+                float* const* chunk = chunkBuffer.getArrayOfWritePointers();
+                readFifo(inputFifo, inputBuffer, chunk, numChannels, 0, numSamples);
+                client.processOffloaded(chunk, numChannels, numSamples);
+                writeFifo(outputFifo, outputBuffer, chunk, numChannels, numSamples);
+            }
+
+            state.store(stopRequested.load() ? stateDisabled : stateIdle);
+        }
+    }
+
+    //==============================================================================
+
+    static void writeFifo(AbstractFifo& fifo, AudioSampleBuffer& buffer,
+        const float* const* source, const int numChannelsToCopy, const int numSamples)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+        for (int channel = 0; channel < numChannelsToCopy; channel++) {
+            buffer.copyFrom(channel, start1, source[channel], size1);
+            if (size2 > 0)
+                buffer.copyFrom(channel, start2, source[channel] + size1, size2);
+        }
+
+        fifo.finishedWrite(size1 + size2);
+    }
+
+    static void readFifo(AbstractFifo& fifo, const AudioSampleBuffer& buffer,
+        float* const* destination, const int numChannelsToCopy, const int offset, const int numSamples)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(numSamples, start1, size1, start2, size2);
+
+        for (int channel = 0; channel < numChannelsToCopy; channel++) {
+            FloatVectorOperations::copy(destination[channel] + offset, buffer.getReadPointer(channel, start1), size1);
+            if (size2 > 0)
+                FloatVectorOperations::copy(destination[channel] + offset + size1, buffer.getReadPointer(channel, start2), size2);
+        }
+
+        fifo.finishedRead(size1 + size2);
+    }
+
+    static void skipFifo(AbstractFifo& fifo, const int numSamples)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(numSamples, start1, size1, start2, size2);
+        fifo.finishedRead(size1 + size2);
+    }
+
+    //==============================================================================
+
+    enum {
+        stateDisabled = 0,
+        stateIdle,
+        stateBusy,
+    };
+
+    Client& client;
+
+    int numChannels = 0;
+    int chunkSize = 1;
+
+    AbstractFifo inputFifo { 1 };
+    AbstractFifo outputFifo { 1 };
+    AudioSampleBuffer inputBuffer;
+    AudioSampleBuffer outputBuffer;
+    AudioSampleBuffer chunkBuffer;
+
+    std::atomic<int> state { stateDisabled };
+    std::atomic<bool> stopRequested { false };
+
+    int currentLatency = 0;
+    int pendingSilence = 0;
+    int pendingSkip = 0;
+
+    std::atomic<int> numMissedDeadlines { 0 };
+    std::atomic<int> numMissedSamples { 0 };
+
+    //==============================================================================
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OffloadWorker)
+};
+
+//==============================================================================
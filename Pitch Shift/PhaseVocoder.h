@@ -0,0 +1,963 @@
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "WindowTables.h"
+#include "VocoderKernel.h"
+#include "ChannelWorkerPool.h"
+#include "PolyphaseResampler.h"
+
+//==============================================================================
+
+/*
+    Size-parameterized phase vocoder. One dsp::FFT (and so one set of twiddles)
+    is built per supported size up front and every buffer is allocated for the
+    largest size in prepare(), so changing the FFT size or the hop size only
+    re-points and clears memory and never allocates.
+
+    Frames are real, so the transforms use the real-only FFT and the phase
+    vocoder works on the N/2+1 non-redundant bins; the inverse transform
+    rebuilds the mirrored half from the conjugate symmetry.
+
+    The synthesis window and the resampler read positions depend on the
+    quantized shift ratio, so they live in a small preallocated cache keyed by
+    the ratio step (ratio = step / hopSize). Entries are filled from the shared
+    prototype window by interpolation, which keeps a cache miss on the audio
+    thread free of allocations and transcendental calls.
+
+    Each resampled frame is written at a ratio dependent offset that puts the
+    window centre at the same output time for every ratio, so the latency only
+    depends on the FFT and hop sizes and stays put while the shift moves.
+
+    Channels share the read/write positions but nothing else, so each channel
+    is one job on the caller's worker pool with its own FFT scratch; the
+    shared positions are advanced once after all channels have finished.
+
+    Within a channel the block is cut at the frame boundaries: the input is
+    copied into the ring a hop at a time and every completed frame is
+    gathered into a batch, the batch goes through the forward FFTs, the
+    kernel and the inverse FFTs stage by stage, is overlap-added, and only
+    then is the batch's output read back. The output ring holds one extra
+    batch so the deferred read never sees its samples overwritten.
+
+    Resampling the synthesis frame is either linear or a polyphase
+    windowed-sinc filter whose kernels are cached with the ratio entry, with
+    the cutoff lowered to 1 / ratio when the frame is decimated. Each frame
+    slot carries circular padding on both sides so the filter taps never
+    need bounds checks.
+
+    Several voices can be rendered from one analysis: each frame's forward
+    FFT and magnitude/frequency analysis run once, then every voice
+    accumulates its own output phases, runs its own inverse FFT and
+    resampler and is overlap-added with its gain into the shared output.
+    A single voice at unity gain keeps the fused kernel.
+
+    The time-domain engine trades quality for latency and uses the same
+    input and output rings. Each voice is a read head that moves through the
+    input ring at the shift ratio, so its delay drifts by 1 - ratio per
+    sample. When the delay leaves a window of a few milliseconds the head
+    jumps by up to twice the grain size and crossfades from its old
+    position. A waveform-similarity search over the last half grain picks
+    the jump so that it lands a whole number of periods away, which keeps
+    the crossfade in phase. The search tries every second lag with a
+    vectorized dot product, then refines around the best one. The input
+    ring repeats its start past its end, so head and search reads never
+    wrap. The reported latency is the middle of the delay window.
+*/
+
+class PhaseVocoder : private ChannelWorkerPool::Job
+{
+public:
+    //==============================================================================
+
+    enum engine {
+        enginePhaseVocoder = 0,
+        engineTimeDomain,
+        numEngines,
+    };
+
+    enum {
+        minFftOrder = WindowTables::minFftOrder,
+        maxFftOrder = WindowTables::maxFftOrder,
+        numFftOrders = maxFftOrder - minFftOrder + 1,
+        maxFftSize = 1 << maxFftOrder,
+        maxVoices = 8,
+        numRatioCacheEntries = maxVoices + 4,
+        maxFramesPerBatch = 16,
+        batchScratchSize = 4 * maxFftSize,
+        minGrainSize = 32,
+        maxGrainSize = maxFftSize / 16,
+    };
+
+    //==============================================================================
+
+    PhaseVocoder()
+    {
+        for (int order = minFftOrder; order <= maxFftOrder; order++)
+            ffts.add(new dsp::FFT(order));
+    }
+
+    //==============================================================================
+
+    void prepare(const int numChannelsToUse, const float minRatio, const int grainSizeToUse)
+    {
+        numChannels = numChannelsToUse;
+        minShiftRatio = minRatio;
+        grainSize = jlimit((int)minGrainSize, (int)maxGrainSize, grainSizeToUse) & ~1;
+        maxOutLength = getOutLength(maxFftSize) + batchScratchSize / 2;
+        const int maxResampledLength = getOutLength(maxFftSize);
+
+        inputBuffer.setSize(numChannels, maxFftSize);
+        outputBuffer.setSize(numChannels, maxOutLength);
+        inputPhase.setSize(numChannels, maxFftSize);
+        outputPhase.setSize(numChannels * maxVoices, maxFftSize);
+        magnitudeBuffer.setSize(numChannels, maxFftSize / 2 + 1);
+        frequencyBuffer.setSize(numChannels, maxFftSize / 2 + 1);
+
+        fftBuffer.setSize(numChannels, batchScratchSize + (maxFramesPerBatch + 1) * PolyphaseResampler::padding);
+        voiceBuffer.setSize(numChannels, 2 * maxFftSize + 2 * PolyphaseResampler::padding);
+        binAdvance.realloc(maxFftSize);
+
+        for (int entry = 0; entry < numRatioCacheEntries; entry++) {
+            ratioCache[entry].synthesisWindow.realloc(maxResampledLength);
+            ratioCache[entry].readIndex.realloc(maxResampledLength);
+            ratioCache[entry].readFraction.realloc(maxResampledLength);
+            ratioCache[entry].readKernel.realloc(maxResampledLength);
+            ratioCache[entry].kernels.realloc(PolyphaseResampler::kernelSize);
+        }
+
+        spliceHeads.realloc(numChannels * maxVoices);
+
+        updateConfiguration();
+    }
+
+    void setConfiguration(const int newEngine,
+        const int newFftSize,
+        const int newOverlap,
+        const int newWindowType,
+        const int newResamplerQuality)
+    {
+        engineType = jlimit(0, numEngines - 1, newEngine);
+        fftSize = jlimit(1 << minFftOrder, (int)maxFftSize, newFftSize);
+        overlap = jmax(1, newOverlap);
+        windowType = jlimit(0, WindowTables::numWindowTypes - 1, newWindowType);
+        resamplerQuality = jlimit(0, PolyphaseResampler::numQualities - 1, newResamplerQuality);
+        updateConfiguration();
+    }
+
+    void resetPhases()
+    {
+        inputPhase.clear();
+        outputPhase.clear();
+    }
+
+    void prepareRatio(const float pitchShift)
+    {
+        if (numChannels != 0 && engineType == enginePhaseVocoder)
+            getRatioCacheEntry(getRatioStep(pitchShift));
+    }
+
+    int getFftSize() const { return fftSize; }
+    int getHopSize() const { return hopSize; }
+    int getNumBins() const { return fftSize / 2 + 1; }
+    bool isTimeDomain() const { return engineType == engineTimeDomain; }
+
+    // Accumulated synthesis phase of one voice, for seeding offline renders.
+    float* getOutputPhase(const int channel, const int voice)
+    {
+        return outputPhase.getWritePointer(channel * maxVoices + voice);
+    }
+
+    // Delay from an input sample to the centre of its shifted output.
+    int getLatencySamples() const { return latencySamples; }
+
+    // Largest latency of any configuration, reached by the largest FFT.
+    int getMaxLatencySamples() const { return getStftLatency(maxFftSize); }
+
+    // Longest time an input sample keeps contributing to the output.
+    int getTailLengthSamples() const
+    {
+        if (engineType == engineTimeDomain)
+            return spliceMinDelay + spliceMaxLag + spliceFadeLength + hopSize;
+
+        return fftSize + getOutLength(fftSize);
+    }
+
+    //==============================================================================
+
+    void process(ChannelWorkerPool& workerPool,
+        float* const* channels,
+        const int numChannelsToProcess,
+        const int numSamples,
+        const float pitchShift)
+    {
+        const float unityGain = 1.0f;
+        process(workerPool, channels, numChannelsToProcess, numSamples, &pitchShift, &unityGain, 1);
+    }
+
+    void process(ChannelWorkerPool& workerPool,
+        float* const* channels,
+        const int numChannelsToProcess,
+        const int numSamples,
+        const float* pitchShifts,
+        const float* gains,
+        const int numVoices)
+    {
+        blockChannels = channels;
+        blockNumSamples = numSamples;
+        blockNumVoices = jlimit(1, (int)maxVoices, numVoices);
+
+        for (int voice = 0; voice < blockNumVoices; voice++) {
+            if (engineType == engineTimeDomain) {
+                blockRatios[voice] = jlimit(minShiftRatio, 1.0f / minShiftRatio, pitchShifts[voice]);
+            }
+            else {
+                const int ratioStep = getRatioStep(pitchShifts[voice]);
+                blockRatios[voice] = (float)ratioStep / (float)hopSize;
+                blockEntries[voice] = &getRatioCacheEntry(ratioStep);
+            }
+            blockGains[voice] = gains[voice];
+        }
+
+        const int numJobs = jmin(numChannelsToProcess, numChannels);
+
+        if (samplesLastFFT + numSamples >= hopSize)
+            workerPool.run(*this, numJobs);
+        else
+            for (int channel = 0; channel < numJobs; channel++)
+                runJob(channel);
+
+        advancePositions(numSamples);
+    }
+
+    // Moves the input ring and the phases through the input exactly as
+    // process() would, but only analyses the frames and never writes any
+    // output. Phase vocoder engine only; the output ring must still be
+    // silent, i.e. this is called before the first process().
+    void analyse(ChannelWorkerPool& workerPool,
+        const float* const* channels,
+        const int numChannelsToProcess,
+        const int numSamples,
+        const float* pitchShifts,
+        const int numVoices)
+    {
+        jassert(engineType == enginePhaseVocoder);
+
+        blockInput = channels;
+        blockNumSamples = numSamples;
+        blockNumVoices = jlimit(1, (int)maxVoices, numVoices);
+
+        for (int voice = 0; voice < blockNumVoices; voice++)
+            blockRatios[voice] = (float)getRatioStep(pitchShifts[voice]) / (float)hopSize;
+
+        const int numJobs = jmin(numChannelsToProcess, numChannels);
+
+        blockAnalyseOnly = true;
+        workerPool.run(*this, numJobs);
+        blockAnalyseOnly = false;
+
+        advancePositions(numSamples);
+    }
+
+private:
+    //==============================================================================
+
+    struct RatioCacheEntry
+    {
+        int ratioStep = -1;
+        int resampledLength = 0;
+        int writeOffset = 0;
+        int64 lastUsed = 0;
+
+        HeapBlock<float> synthesisWindow;
+        HeapBlock<int> readIndex;
+        HeapBlock<float> readFraction;
+        HeapBlock<int> readKernel;
+        HeapBlock<float> kernels;
+    };
+
+    struct SpliceHead
+    {
+        float delay;
+        float fadingDelay;
+        int fadeRemaining;
+    };
+
+    void runJob(const int channel) override
+    {
+        if (blockAnalyseOnly) {
+            runAnalysisJob(channel);
+            return;
+        }
+
+        if (engineType == engineTimeDomain) {
+            runTimeDomainJob(channel);
+            return;
+        }
+
+        float* channelData = blockChannels[channel];
+        float* frames = fftBuffer.getWritePointer(channel) + PolyphaseResampler::padding;
+        float* inputData = inputBuffer.getWritePointer(channel);
+        float* outputData = outputBuffer.getWritePointer(channel);
+        float* channelInputPhase = inputPhase.getWritePointer(channel);
+        float* channelOutputPhase = outputPhase.getWritePointer(channel * maxVoices);
+        const bool fusedKernel = blockNumVoices == 1 && blockGains[0] == 1.0f;
+
+        const int frameStride = 2 * fftSize + PolyphaseResampler::padding;
+        const int numBins = fftSize / 2 + 1;
+
+        int currInWritePos = inWritePos;
+        int currOutWritePos = outWritePos;
+        int currOutReadPos = outReadPos;
+        int currSamplesLastFFT = samplesLastFFT;
+
+        int sample = 0;
+        while (sample < blockNumSamples) {
+
+            // Copy the input into the ring up to each frame boundary and window
+            // every frame that completes into its own slot of the batch.
+            const int batchStart = sample;
+            int numFrames = 0;
+
+            while (sample < blockNumSamples && numFrames < framesPerBatch) {
+                const int segment = jmin(hopSize - currSamplesLastFFT, blockNumSamples - sample);
+                writeInput(inputData, currInWritePos, channelData + sample, segment);
+
+                currInWritePos = (currInWritePos + segment) % inLength;
+                currSamplesLastFFT += segment;
+                sample += segment;
+
+                if (currSamplesLastFFT >= hopSize) {
+                    currSamplesLastFFT = 0;
+                    gatherFrame(frames + numFrames * frameStride, inputData, currInWritePos);
+                    numFrames++;
+                }
+            }
+
+            // Run each stage over the whole batch so the FFT twiddles and the
+            // kernel stay hot in cache.
+            for (int frame = 0; frame < numFrames; frame++)
+                fft->performRealOnlyForwardTransform(frames + frame * frameStride, true);
+
+            if (fusedKernel) {
+                for (int frame = 0; frame < numFrames; frame++)
+                    VocoderKernel::process(frames + frame * frameStride,
+                        channelInputPhase,
+                        channelOutputPhase,
+                        binAdvance,
+                        numBins,
+                        blockRatios[0]);
+
+                for (int frame = 0; frame < numFrames; frame++) {
+                    float* frameData = frames + frame * frameStride;
+                    fft->performRealOnlyInverseTransform(frameData);
+                    padFrame(frameData);
+                }
+
+                for (int frame = 0; frame < numFrames; frame++) {
+                    overlapAddFrame(outputData, currOutWritePos, frames + frame * frameStride, *blockEntries[0], 1.0f);
+                    currOutWritePos = (currOutWritePos + hopSize) % outLength;
+                }
+            }
+            else {
+                for (int frame = 0; frame < numFrames; frame++) {
+                    renderVoices(channel, frames + frame * frameStride, outputData, currOutWritePos);
+                    currOutWritePos = (currOutWritePos + hopSize) % outLength;
+                }
+            }
+
+            // Every frame lands after the sample that completed it, so the
+            // output of the batch can be read once all its frames are added.
+            const int batchLength = sample - batchStart;
+            readOutput(outputData, currOutReadPos, channelData + batchStart, batchLength);
+            currOutReadPos = (currOutReadPos + batchLength) % outLength;
+        }
+    }
+
+    void runAnalysisJob(const int channel)
+    {
+        const float* channelData = blockInput[channel];
+        float* frame = fftBuffer.getWritePointer(channel) + PolyphaseResampler::padding;
+        float* inputData = inputBuffer.getWritePointer(channel);
+        float* magnitude = magnitudeBuffer.getWritePointer(channel);
+        float* frequency = frequencyBuffer.getWritePointer(channel);
+        const int numBins = fftSize / 2 + 1;
+
+        int currInWritePos = inWritePos;
+        int currSamplesLastFFT = samplesLastFFT;
+
+        int sample = 0;
+        while (sample < blockNumSamples) {
+            const int segment = jmin(hopSize - currSamplesLastFFT, blockNumSamples - sample);
+            writeInput(inputData, currInWritePos, channelData + sample, segment);
+
+            currInWritePos = (currInWritePos + segment) % inLength;
+            currSamplesLastFFT += segment;
+            sample += segment;
+
+            if (currSamplesLastFFT >= hopSize) {
+                currSamplesLastFFT = 0;
+                gatherFrame(frame, inputData, currInWritePos);
+                fft->performRealOnlyForwardTransform(frame, true);
+
+                VocoderKernel::analyse(frame, inputPhase.getWritePointer(channel), binAdvance, numBins, magnitude, frequency);
+
+                for (int voice = 0; voice < blockNumVoices; voice++)
+                    VocoderKernel::accumulate(outputPhase.getWritePointer(channel * maxVoices + voice),
+                        frequency,
+                        numBins,
+                        blockRatios[voice]);
+            }
+        }
+    }
+
+    void renderVoices(const int channel, const float* spectrum, float* outputData, const int writePos)
+    {
+        const int numBins = fftSize / 2 + 1;
+        float* magnitude = magnitudeBuffer.getWritePointer(channel);
+        float* frequency = frequencyBuffer.getWritePointer(channel);
+        float* voiceData = voiceBuffer.getWritePointer(channel) + PolyphaseResampler::padding;
+
+        VocoderKernel::analyse(spectrum, inputPhase.getWritePointer(channel), binAdvance, numBins, magnitude, frequency);
+
+        for (int voice = 0; voice < blockNumVoices; voice++) {
+            VocoderKernel::synthesise(voiceData,
+                magnitude,
+                frequency,
+                outputPhase.getWritePointer(channel * maxVoices + voice),
+                numBins,
+                blockRatios[voice]);
+
+            fft->performRealOnlyInverseTransform(voiceData);
+            padFrame(voiceData);
+            overlapAddFrame(outputData, writePos, voiceData, *blockEntries[voice], blockGains[voice]);
+        }
+    }
+
+    void runTimeDomainJob(const int channel)
+    {
+        float* channelData = blockChannels[channel];
+        float* inputData = inputBuffer.getWritePointer(channel);
+        float* outputData = outputBuffer.getWritePointer(channel);
+        SpliceHead* heads = spliceHeads + channel * maxVoices;
+
+        int currInWritePos = inWritePos;
+        int currOutReadPos = outReadPos;
+        int currSamplesLastHop = samplesLastFFT;
+
+        // The output ring is one hop long and every segment ends on a hop
+        // boundary, so a segment never wraps in it.
+        int sample = 0;
+        while (sample < blockNumSamples) {
+            const int segment = jmin(hopSize - currSamplesLastHop, blockNumSamples - sample);
+            writeInput(inputData, currInWritePos, channelData + sample, segment);
+            mirrorInput(inputData, currInWritePos, segment);
+
+            for (int voice = 0; voice < blockNumVoices; voice++)
+                renderHead(heads[voice], outputData + currOutReadPos, inputData, currInWritePos, segment,
+                    blockRatios[voice], blockGains[voice]);
+
+            readOutput(outputData, currOutReadPos, channelData + sample, segment);
+
+            currInWritePos = (currInWritePos + segment) % inLength;
+            currOutReadPos = (currOutReadPos + segment) % outLength;
+            currSamplesLastHop = (currSamplesLastHop + segment) % hopSize;
+            sample += segment;
+        }
+    }
+
+    void renderHead(SpliceHead& head,
+        float* outputData,
+        const float* inputData,
+        const int firstInputPos,
+        const int numSamples,
+        const float ratio,
+        const float gain) const
+    {
+        // Output sample i reads the input delay samples before input sample
+        // i, and the delay drifts by 1 - ratio per sample. Runs are cut where
+        // the delay leaves its range, where a splice starts and where its
+        // crossfade ends.
+        const float drift = 1.0f - ratio;
+        const float maxDelay = (float)(spliceMinDelay + spliceMaxLag);
+
+        int sample = 0;
+        while (sample < numSamples) {
+            const int inputPos = firstInputPos + sample;
+
+            if (head.fadeRemaining == 0) {
+                if (drift < 0.0f && head.delay < (float)spliceMinDelay) {
+                    head.fadingDelay = head.delay;
+                    head.delay += (float)findSpliceLag(inputData, inputPos, head.delay, -1);
+                    head.fadeRemaining = spliceFadeLength;
+                }
+                else if (drift > 0.0f && head.delay > maxDelay) {
+                    head.fadingDelay = head.delay;
+                    head.delay -= (float)findSpliceLag(inputData, inputPos, head.delay, 1);
+                    head.fadeRemaining = spliceFadeLength;
+                }
+            }
+
+            int run = numSamples - sample;
+            if (head.fadeRemaining > 0)
+                run = jmin(run, head.fadeRemaining);
+            else if (drift < 0.0f)
+                run = jmin(run, (int)((head.delay - (float)spliceMinDelay) / -drift) + 1);
+            else if (drift > 0.0f)
+                run = jmin(run, (int)((maxDelay - head.delay) / drift) + 1);
+
+            float* outputRun = outputData + sample;
+
+            if (head.fadeRemaining > 0) {
+                const float gainIncrement = gain / (float)(spliceFadeLength + 1);
+                float fadeGain = gainIncrement * (float)(spliceFadeLength + 1 - head.fadeRemaining);
+                float position, fadingPosition;
+                const float* headData = getHeadData(inputData, inputPos, head.delay, position);
+                const float* fadingData = getHeadData(inputData, inputPos, head.fadingDelay, fadingPosition);
+
+                for (int index = 0; index < run; index++) {
+                    const float value = interpolate(headData, position);
+                    const float fadingValue = interpolate(fadingData, fadingPosition);
+
+                    outputRun[index] += fadingValue * (gain - fadeGain) + value * fadeGain;
+                    fadeGain += gainIncrement;
+                    position += ratio;
+                    fadingPosition += ratio;
+                }
+
+                head.fadingDelay += drift * (float)run;
+                head.fadeRemaining -= run;
+            }
+            else {
+                float position;
+                const float* headData = getHeadData(inputData, inputPos, head.delay, position);
+
+                for (int index = 0; index < run; index++) {
+                    outputRun[index] += interpolate(headData, position) * gain;
+                    position += ratio;
+                }
+            }
+
+            head.delay += drift * (float)run;
+            sample += run;
+        }
+    }
+
+    int findSpliceLag(const float* inputData, const int inputPos, const float delay, const int direction) const
+    {
+        // Compare the input the head has just read with the input one lag
+        // further back (direction -1) or forward (direction 1) and jump by
+        // the lag where they match best, so the crossfade joins two copies of
+        // the same waveform. Lags are whole samples, so the fractional read
+        // position carries over. Every second lag is tried first and the
+        // best one is refined by its neighbours.
+        const int length = spliceFadeLength;
+        const int minLag = spliceMaxLag - spliceSearch;
+        const int headStart = (int)floorf(-delay) - length;
+        const int earliest = headStart - (direction < 0 ? spliceMaxLag : 0);
+        const float* base = inputData + getInputIndex(inputPos, earliest);
+        const float* headData = base + (headStart - earliest);
+
+        int bestLag = spliceMaxLag;
+        float bestCorrelation = correlate(headData, headData + direction * bestLag, length);
+
+        for (int lag = spliceMaxLag - 2; lag >= minLag; lag -= 2) {
+            const float correlation = correlate(headData, headData + direction * lag, length);
+            if (correlation > bestCorrelation) {
+                bestCorrelation = correlation;
+                bestLag = lag;
+            }
+        }
+
+        const int coarseLag = bestLag;
+        for (int lag = coarseLag - 1; lag <= coarseLag + 1; lag += 2) {
+            if (lag < minLag || lag > spliceMaxLag)
+                continue;
+
+            const float correlation = correlate(headData, headData + direction * lag, length);
+            if (correlation > bestCorrelation) {
+                bestCorrelation = correlation;
+                bestLag = lag;
+            }
+        }
+
+        return bestLag;
+    }
+
+    const float* getHeadData(const float* inputData, const int inputPos, const float delay, float& position) const
+    {
+        const float start = -delay;
+        const int startIndex = (int)floorf(start);
+        position = start - (float)startIndex;
+        return inputData + getInputIndex(inputPos, startIndex);
+    }
+
+    int getInputIndex(const int inputPos, const int relativePos) const
+    {
+        const int index = inputPos + relativePos;
+        return index < 0 ? index + inLength : index;
+    }
+
+    static float interpolate(const float* data, const float position)
+    {
+        const int ix = (int)position;
+        const float fraction = position - (float)ix;
+        return data[ix] + fraction * (data[ix + 1] - data[ix]);
+    }
+
+    static float correlate(const float* a, const float* b, const int numSamples)
+    {
+        int index = 0;
+        float sum = 0.0f;
+
+#if PITCHSHIFT_VOCODER_SSE2
+        __m128 sum4 = _mm_setzero_ps();
+        for (; index + 4 <= numSamples; index += 4)
+            sum4 = _mm_add_ps(sum4, _mm_mul_ps(_mm_loadu_ps(a + index), _mm_loadu_ps(b + index)));
+
+        sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+        sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, _MM_SHUFFLE(1, 1, 1, 1)));
+        sum = _mm_cvtss_f32(sum4);
+#endif
+
+        for (; index < numSamples; index++)
+            sum += a[index] * b[index];
+
+        return sum;
+    }
+
+    void mirrorInput(float* inputData, const int writePos, const int numSamples) const
+    {
+        if (writePos < inputGuard)
+            FloatVectorOperations::copy(inputData + inLength + writePos, inputData + writePos,
+                jmin(numSamples, inputGuard - writePos));
+
+        const int wrapped = writePos + numSamples - inLength;
+        if (wrapped > 0)
+            FloatVectorOperations::copy(inputData + inLength, inputData, jmin(wrapped, inputGuard));
+    }
+
+    //==============================================================================
+
+    void writeInput(float* inputData, const int writePos, const float* source, const int numSamples) const
+    {
+        const int firstPart = jmin(numSamples, inLength - writePos);
+        FloatVectorOperations::copy(inputData + writePos, source, firstPart);
+        FloatVectorOperations::copy(inputData, source + firstPart, numSamples - firstPart);
+    }
+
+    void gatherFrame(float* frameData, const float* inputData, const int oldestPos) const
+    {
+        const int firstPart = inLength - oldestPos;
+        FloatVectorOperations::multiply(frameData, inputData + oldestPos, analysisWindow, firstPart);
+        FloatVectorOperations::multiply(frameData + firstPart, inputData, analysisWindow + firstPart, fftSize - firstPart);
+    }
+
+    void padFrame(float* frameData) const
+    {
+        const int pad = PolyphaseResampler::padding;
+        FloatVectorOperations::copy(frameData - pad, frameData + fftSize - pad, pad);
+        FloatVectorOperations::copy(frameData + fftSize, frameData, pad);
+    }
+
+    void overlapAddFrame(float* outputData,
+        const int writePos,
+        const float* frameData,
+        const RatioCacheEntry& entry,
+        const float gain) const
+    {
+        int outIndex = writePos + entry.writeOffset;
+        if (outIndex >= outLength) outIndex -= outLength;
+
+        const int numTaps = PolyphaseResampler::getNumTaps(resamplerQuality);
+        const float* firstTap = frameData - (numTaps / 2 - 1);
+
+        int fftIndex = 0;
+        while (fftIndex < entry.resampledLength) {
+            const int run = jmin(entry.resampledLength - fftIndex, outLength - outIndex);
+            float* outputRun = outputData + outIndex;
+
+            if (resamplerQuality == PolyphaseResampler::qualityLinear) {
+                for (int index = 0; index < run; index++, fftIndex++) {
+                    int ix = entry.readIndex[fftIndex];
+                    float sample1 = frameData[ix];
+                    float sample2 = frameData[ix + 1];
+                    float resampled = sample1 + entry.readFraction[fftIndex] * (sample2 - sample1);
+
+                    outputRun[index] += resampled * entry.synthesisWindow[fftIndex] * gain;
+                }
+            }
+            else {
+                for (int index = 0; index < run; index++, fftIndex++) {
+                    float resampled = PolyphaseResampler::interpolate(firstTap + entry.readIndex[fftIndex],
+                        entry.kernels + entry.readKernel[fftIndex],
+                        numTaps);
+
+                    outputRun[index] += resampled * entry.synthesisWindow[fftIndex] * gain;
+                }
+            }
+
+            outIndex = 0;
+        }
+    }
+
+    void readOutput(float* outputData, const int readPos, float* destination, const int numSamples) const
+    {
+        const int firstPart = jmin(numSamples, outLength - readPos);
+        FloatVectorOperations::copy(destination, outputData + readPos, firstPart);
+        FloatVectorOperations::clear(outputData + readPos, firstPart);
+        FloatVectorOperations::copy(destination + firstPart, outputData, numSamples - firstPart);
+        FloatVectorOperations::clear(outputData, numSamples - firstPart);
+    }
+
+    void advancePositions(const int numSamples)
+    {
+        const int numFrames = (samplesLastFFT + numSamples) / hopSize;
+
+        samplesLastFFT = (samplesLastFFT + numSamples) % hopSize;
+        inWritePos = (inWritePos + numSamples) % inLength;
+        outReadPos = (outReadPos + numSamples) % outLength;
+        outWritePos = (outWritePos + numFrames * hopSize) % outLength;
+    }
+
+    //==============================================================================
+
+    int getRatioStep(const float pitchShift) const
+    {
+        return jmax(1, (int)roundf(pitchShift * (float)hopSize));
+    }
+
+    const RatioCacheEntry& getRatioCacheEntry(const int ratioStep)
+    {
+        RatioCacheEntry* leastRecentlyUsed = &ratioCache[0];
+        ratioCacheCounter++;
+
+        for (int index = 0; index < numRatioCacheEntries; index++) {
+            RatioCacheEntry& entry = ratioCache[index];
+
+            if (entry.ratioStep == ratioStep) {
+                entry.lastUsed = ratioCacheCounter;
+                return entry;
+            }
+
+            if (entry.lastUsed < leastRecentlyUsed->lastUsed)
+                leastRecentlyUsed = &entry;
+        }
+
+        fillRatioCacheEntry(*leastRecentlyUsed, ratioStep);
+        leastRecentlyUsed->lastUsed = ratioCacheCounter;
+        return *leastRecentlyUsed;
+    }
+
+    void fillRatioCacheEntry(RatioCacheEntry& entry, const int ratioStep)
+    {
+        // A frame computed after input sample n holds samples n - N + 1 .. n
+        // and its output starts at n + 1, so frame position p lands at
+        // n + 1 + offset + p / ratio. Choosing the offset below puts the window
+        // centre p = (N - 1) / 2 at n - (N - 1) / 2 + latency for every ratio.
+        // The integer part moves the write position, the fraction shifts the
+        // read positions.
+        const float ratio = (float)ratioStep / (float)hopSize;
+        const float halfFrame = 0.5f * (float)(fftSize - 1);
+        const float offset = jmax(0.0f, (float)(latencySamples - 1) - halfFrame - halfFrame / ratio);
+        const int writeOffset = (int)ceilf(offset);
+        const float delay = (float)writeOffset - offset;
+        const int resampledLength = jlimit(2, outLength - writeOffset,
+            (int)floorf((float)(fftSize - 1) / ratio - delay) + 1);
+
+        entry.ratioStep = ratioStep;
+        entry.resampledLength = resampledLength;
+        entry.writeOffset = writeOffset;
+
+        const int numTaps = PolyphaseResampler::getNumTaps(resamplerQuality);
+        if (resamplerQuality != PolyphaseResampler::qualityLinear)
+            resampler->fillKernels(entry.kernels, numTaps, jmin(1.0f, 1.0f / ratio));
+
+        for (int index = 0; index < resampledLength; index++) {
+
+            float x = jmin(((float)index + delay) * ratio, (float)(fftSize - 1));
+            int ix = (int)x;
+            entry.readIndex[index] = ix;
+            entry.readFraction[index] = x - (float)ix;
+            entry.readKernel[index] = roundToInt(entry.readFraction[index] * (float)PolyphaseResampler::numPhases) * numTaps;
+
+            float position = x * (float)WindowTables::prototypeSize / (float)(fftSize - 1);
+            int tableIndex = jmin((int)position, (int)WindowTables::prototypeSize - 1);
+            float fraction = position - (float)tableIndex;
+            float window = synthesisPrototype[tableIndex]
+                + fraction * (synthesisPrototype[tableIndex + 1] - synthesisPrototype[tableIndex]);
+
+            entry.synthesisWindow[index] = window * windowScaleFactor * ratio;
+        }
+    }
+
+    void clearRatioCache()
+    {
+        for (int index = 0; index < numRatioCacheEntries; index++) {
+            ratioCache[index].ratioStep = -1;
+            ratioCache[index].lastUsed = 0;
+        }
+    }
+
+    //==============================================================================
+
+    void updateConfiguration()
+    {
+        const int fftOrder = getFftOrder(fftSize);
+
+        hopSize = engineType == engineTimeDomain ? grainSize / 2 : jmax(1, fftSize / overlap);
+        fft = ffts[fftOrder - minFftOrder];
+
+        analysisWindow = windowTables->getAnalysisWindow(windowType, fftOrder);
+        synthesisPrototype = windowTables->getSynthesisPrototype(windowType);
+        windowScaleFactor = (float)hopSize / windowTables->getWindowSum(windowType, fftOrder);
+
+        if (numChannels == 0)
+            return;
+
+        if (engineType == engineTimeDomain) {
+            // A head moving towards the newest sample must still be at least
+            // one sample behind it at the end of a crossfade at the highest
+            // ratio. The delay starts in the middle of its range, which is
+            // the latency; splices keep it within half the range of there.
+            const float maxRatio = 1.0f / minShiftRatio;
+
+            spliceFadeLength = grainSize / 2;
+            spliceSearch = grainSize;
+            spliceMaxLag = 2 * grainSize;
+            spliceMinDelay = (int)ceilf((maxRatio - 1.0f) * (float)(spliceFadeLength + 1)) + 2;
+            latencySamples = spliceMinDelay + spliceMaxLag / 2;
+
+            inputGuard = spliceMaxLag + spliceFadeLength + (int)ceilf(maxRatio * (float)hopSize) + 4;
+            inLength = spliceMinDelay + 2 * spliceMaxLag + 2 * spliceFadeLength + hopSize + 8;
+            jassert(inLength + inputGuard <= inputBuffer.getNumSamples());
+
+            outLength = hopSize;
+
+            for (int index = 0; index < numChannels * maxVoices; index++) {
+                spliceHeads[index].delay = (float)latencySamples;
+                spliceHeads[index].fadingDelay = (float)latencySamples;
+                spliceHeads[index].fadeRemaining = 0;
+            }
+        }
+        else {
+            latencySamples = getStftLatency(fftSize);
+
+            inLength = fftSize;
+            framesPerBatch = jlimit(1, (int)maxFramesPerBatch, (int)batchScratchSize / (2 * fftSize));
+            outLength = getOutLength(fftSize) + framesPerBatch * hopSize;
+        }
+
+        inWritePos = 0;
+        inputBuffer.clear();
+
+        outWritePos = hopSize % outLength;
+        outReadPos = 0;
+        outputBuffer.clear();
+
+        fftBuffer.clear();
+
+        samplesLastFFT = 0;
+
+        for (int index = 0; index < fftSize; ++index) {
+            binAdvance[index] = 2.0f * M_PI * index / (float)fftSize * (float)hopSize;
+        }
+
+        resetPhases();
+        clearRatioCache();
+    }
+
+    int getOutLength(const int size) const
+    {
+        // The furthest write reaches latency - (N - 1) / 2 + (N - 1) / (2 * ratio)
+        // plus one sample past the next read position, which is largest at the
+        // minimum ratio.
+        return (int)ceilf((float)(size - 1) / minShiftRatio) + 3;
+    }
+
+    int getStftLatency(const int size) const
+    {
+        const float halfFrame = 0.5f * (float)(size - 1);
+        return (int)ceilf(1.0f + halfFrame + halfFrame / minShiftRatio);
+    }
+
+    static int getFftOrder(const int size)
+    {
+        int order = 0;
+        while ((1 << (order + 1)) <= size)
+            order++;
+
+        return order;
+    }
+
+    //==============================================================================
+
+    OwnedArray<dsp::FFT> ffts;
+    dsp::FFT* fft = nullptr;
+
+    SharedResourcePointer<WindowTables> windowTables;
+    SharedResourcePointer<PolyphaseResampler> resampler;
+    const float* analysisWindow = nullptr;
+    const float* synthesisPrototype = nullptr;
+
+    int numChannels = 0;
+    float minShiftRatio = 0.5f;
+    int fftSize = 512;
+    int overlap = 8;
+    int hopSize = 64;
+    int windowType = WindowTables::windowTypeHann;
+    int resamplerQuality = PolyphaseResampler::qualitySinc8;
+    int engineType = enginePhaseVocoder;
+
+    int inLength = 0;
+    int inWritePos = 0;
+    AudioSampleBuffer inputBuffer;
+
+    int maxOutLength = 0;
+    int outLength = 0;
+    int outWritePos = 0;
+    int outReadPos = 0;
+    AudioSampleBuffer outputBuffer;
+
+    AudioSampleBuffer fftBuffer;
+    AudioSampleBuffer voiceBuffer;
+    AudioSampleBuffer magnitudeBuffer;
+    AudioSampleBuffer frequencyBuffer;
+
+    float* const* blockChannels = nullptr;
+    const float* const* blockInput = nullptr;
+    bool blockAnalyseOnly = false;
+    int blockNumSamples = 0;
+    int blockNumVoices = 1;
+    float blockRatios[maxVoices];
+    float blockGains[maxVoices];
+    const RatioCacheEntry* blockEntries[maxVoices];
+
+    RatioCacheEntry ratioCache[numRatioCacheEntries];
+    int64 ratioCacheCounter = 0;
+
+    int samplesLastFFT = 0;
+    int framesPerBatch = 1;
+    int latencySamples = 0;
+    float windowScaleFactor = 0.0f;
+
+    int grainSize = 128;
+    int spliceFadeLength = 64;
+    int spliceSearch = 128;
+    int spliceMaxLag = 256;
+    int spliceMinDelay = 0;
+    int inputGuard = 0;
+    HeapBlock<SpliceHead> spliceHeads;
+
+    HeapBlock<float> binAdvance;
+    AudioSampleBuffer inputPhase;
+    AudioSampleBuffer outputPhase;
+
+    //==============================================================================
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PhaseVocoder)
+};
+
+//==============================================================================
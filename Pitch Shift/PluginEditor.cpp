@@ -32,17 +32,47 @@ PitchShiftAudioProcessorEditor::PitchShiftAudioProcessorEditor(PitchShiftAudioPr
             }
 
             //======================================
-           
-            if (i == 0) {
-                Label* label;
-                labels.add(label = new Label(parameter->name, parameter->name));
-                label->attachToComponent(components.getLast(), true);
-                addAndMakeVisible(label);
-
-                components.getLast()->setName(parameter->name);
-                components.getLast()->setComponentID(parameter->paramID);
-                addAndMakeVisible(components.getLast());
+
+            else if (processor.ppManager.parameterTypes[i] == "ToggleButton") {
+                ToggleButton* button;
+                toggles.add(button = new ToggleButton());
+                button->setToggleState(parameter->getDefaultValue(), dontSendNotification);
+
+                ButtonAttachment* buttonAttachment;
+                buttonAttachments.add(buttonAttachment =
+                    new ButtonAttachment(processor.ppManager.valueTreeState, parameter->paramID, *button));
+
+                components.add(button);
+                height += buttonHeight;
             }
+
+            //======================================
+
+            else if (processor.ppManager.parameterTypes[i] == "ComboBox") {
+                ComboBox* comboBox;
+                comboBoxes.add(comboBox = new ComboBox());
+                comboBox->setEditableText(false);
+                comboBox->setJustificationType(Justification::left);
+                comboBox->addItemList(processor.ppManager.comboBoxItemLists[counter++], 1);
+
+                ComboBoxAttachment* comboBoxAttachment;
+                comboBoxAttachments.add(comboBoxAttachment =
+                    new ComboBoxAttachment(processor.ppManager.valueTreeState, parameter->paramID, *comboBox));
+
+                components.add(comboBox);
+                height += comboBoxHeight;
+            }
+
+            //======================================
+
+            Label* label;
+            labels.add(label = new Label(parameter->name, parameter->name));
+            label->attachToComponent(components.getLast(), true);
+            addAndMakeVisible(label);
+
+            components.getLast()->setName(parameter->name);
+            components.getLast()->setComponentID(parameter->paramID);
+            addAndMakeVisible(components.getLast());
         }
     }
 
@@ -20,54 +20,59 @@ ppManager(*this)
         [this](float value) { return powf(2.0f, value / 12.0f); })
     , fftSizeCB(ppManager, "FFT size", fftSizeItemsUI, fftSize512,
         [this](float value) {
-            const ScopedLock sl(lock);
             value = (float)(1 << ((int)value + 5));
             fftSizeCB.setCurrentAndTargetValue(value);
-            updateFftSize();
-            updateHopSize();
-
-            for (int sample = 0; sample < fftSize; sample++) {
-                fftWindow[sample] = 1.0f - fabs(2.0f * (float)sample / (float)(fftSize - 1) - 1.0f);
-            }
-            
-            updateWindowScaleFactor();
+            requestVocoderUpdate();
             return value;
         })
     , hopSizeCB(ppManager, "Hop size", hopSizeItemsUI, hopSize8,
         [this](float value) {
-            const ScopedLock sl(lock);
             value = (float)(1 << ((int)value + 1));
             hopSizeCB.setCurrentAndTargetValue(value);
-            updateFftSize();
-            updateHopSize();
-            
-            for (int sample = 0; sample < fftSize; sample++) {
-                fftWindow[sample] = 1.0f - fabs(2.0f * (float)sample / (float)(fftSize - 1) - 1.0f);
-            }
-
-            updateWindowScaleFactor();
+            requestVocoderUpdate();
             return value;
         })
     , windowTypeCB(ppManager, "Window type", windowTypeItemsUI, windowTypeHann,
         [this](float value) {
-            const ScopedLock sl(lock);
             windowTypeCB.setCurrentAndTargetValue(value);
-            updateFftSize();
-            updateHopSize();
-
-            for (int sample = 0; sample < fftSize; sample++) {
-                fftWindow[sample] = 1.0f - fabs(2.0f * (float)sample / (float)(fftSize - 1) - 1.0f);
-            }
-
-            updateWindowScaleFactor();
+            requestVocoderUpdate();
+            return value;
+        })
+    , resamplerQualityCB(ppManager, "Resampler", resamplerQualityItemsUI, resamplerQualitySinc8,
+        [this](float value) {
+            resamplerQualityCB.setCurrentAndTargetValue(value);
+            requestVocoderUpdate();
             return value;
         })
+    , offloadButton(ppManager, "Offload", false)
+    , harmonizerButton(ppManager, "Harmonizer", false)
+    , voicesCB(ppManager, "Voices", voicesItemsUI, 2)
+    , offloadWorker(*this)
 {
+    const float defaultVoiceShifts[PhaseVocoder::maxVoices] = { 0.0f, 4.0f, 7.0f, 12.0f, -12.0f, -5.0f, -8.0f, 3.0f };
+
+    for (int voice = 0; voice < PhaseVocoder::maxVoices; voice++) {
+        const String voiceName = "Voice " + String(voice + 1);
+
+        voiceShiftSliders.add(new PluginParameterLinSlider(ppManager, voiceName + " shift", " Semitone(s)",
+            -12.0f, 12.0f, defaultVoiceShifts[voice],
+            [](float value) { return powf(2.0f, value / 12.0f); }));
+        voiceGainSliders.add(new PluginParameterLinSlider(ppManager, voiceName + " gain", "", 0.0f, 1.0f, 0.5f));
+    }
+
+    engineCB.reset(new PluginParameterComboBox(ppManager, "Engine", engineItemsUI, enginePhaseVocoder,
+        [this](float value) {
+            requestVocoderUpdate();
+            return value;
+        }));
+
     ppManager.valueTreeState.state = ValueTree(Identifier(getName().removeCharacters("- ")));
 }
 
 PitchShiftAudioProcessor::~PitchShiftAudioProcessor()
 {
+    cancelPendingUpdate();
+    offloadWorker.release();
 }
 
 //==============================================================================
@@ -76,211 +81,362 @@ void PitchShiftAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBl
 {
     const double smoothTime = 1e-3;
     pitchShiftSlider.reset(sampleRate, smoothTime);
+    engineCB->reset(sampleRate, smoothTime);
     fftSizeCB.reset(sampleRate, smoothTime);
     hopSizeCB.reset(sampleRate, smoothTime);
     windowTypeCB.reset(sampleRate, smoothTime);
+    resamplerQualityCB.reset(sampleRate, smoothTime);
+    offloadButton.reset(sampleRate, smoothTime);
+    harmonizerButton.reset(sampleRate, smoothTime);
+    voicesCB.reset(sampleRate, smoothTime);
+    for (int voice = 0; voice < PhaseVocoder::maxVoices; voice++) {
+        voiceShiftSliders[voice]->reset(sampleRate, smoothTime);
+        voiceGainSliders[voice]->reset(sampleRate, smoothTime);
+    }
 
     //======================================
 
+    offloadWorker.prepare(getTotalNumInputChannels(), samplesPerBlock, PhaseVocoder::maxFftSize + samplesPerBlock);
+    offloadActive.store(false);
+    maxBlockSize = samplesPerBlock;
+
+    const ScopedLock sl(configurationLock);
+    const float minRatio = powf(2.0f, pitchShiftSlider.minValue / 12.0f);
+    const int grainSize = getGrainSize(sampleRate);
+
+    for (int index = 0; index < numVocoders; index++) {
+        vocoders[index].prepare(getTotalNumInputChannels(), minRatio, grainSize);
+        vocoderInUse[index].store(false);
+    }
+
+    activeVocoder = &vocoders[0];
+    activeVocoder->setConfiguration((int)engineCB->getTargetValue(),
+        (int)fftSizeCB.getTargetValue(),
+        (int)hopSizeCB.getTargetValue(),
+        (int)windowTypeCB.getTargetValue(),
+        (int)resamplerQualityCB.getTargetValue());
+    activeVocoder->prepareRatio(pitchShiftSlider.getTargetValue());
+    vocoderInUse[0].store(true);
+    updateLatency(*activeVocoder);
+    setLatencySamples(getReportedLatency());
+    pendingVocoder.store(nullptr);
+    fadingVocoder = nullptr;
+
+    crossfadeBuffer.setSize(getTotalNumInputChannels(), samplesPerBlock);
+    crossfadeBuffer.clear();
+    alignmentBuffer.setSize(getTotalNumInputChannels(), activeVocoder->getMaxLatencySamples() + 1);
+    alignmentBuffer.clear();
+
+    workerPool.prepare(getTotalNumInputChannels(), Thread::realtimeAudioPriority);
+
+    vocodersPrepared = true;
     resetPhases = true;
 }
 
 void PitchShiftAudioProcessor::releaseResources()
 {
+    offloadWorker.release();
+    offloadActive.store(false);
 }
 
 void PitchShiftAudioProcessor::processBlock(AudioSampleBuffer& buffer, MidiBuffer& midiMessages)
 {
-    const ScopedLock sl(lock);
-
     ScopedNoDenormals noDenormals;
-    
-    int currOutReadPos;
-    int currInWritePos;
-    int currOutWritePos;
-    int currSamplesLastFFT;
 
-    float pitchShift = pitchShiftSlider.getNextValue();
-    float ratio = roundf(pitchShift * (float)hopSize) / (float)hopSize;
-    int resampledLength = floorf((float)fftSize / ratio);
+    const int numInputChannels = getTotalNumInputChannels();
+    const int numSamples = buffer.getNumSamples();
 
-    HeapBlock<float> resampledOutput(resampledLength, true);
-    HeapBlock<float> synthesisWindow(resampledLength, true);
+    // Switching offload off only asks the worker to stop; its output is served
+    // until it confirms, so processBlock never waits for it.
+    const bool offload = (bool)offloadButton.getTargetValue();
 
-    for (int sample = 0; sample < resampledLength; sample++) {
-        synthesisWindow[sample] = 1.0f - fabs(2.0f * (float)sample / (float)(resampledLength - 1) - 1.0f);
+    if (offloadActive.load() && (! offload || offloadWorker.isDisabling())) {
+        if (offloadWorker.disable()) {
+            offloadActive.store(false);
+            reportLatency();
+        }
     }
 
-    for (int channel = 0; channel < getTotalNumInputChannels(); channel++) {
-        float* channelData = buffer.getWritePointer(channel);
+    if (offload && ! offloadActive.load()) {
+        offloadWorker.enable(offloadLatencySamples.load());
+        offloadActive.store(true);
+        reportLatency();
+    }
 
-        currInWritePos = inWritePos;
-        currOutWritePos = outWritePos;
-        currOutReadPos = outReadPos;
-        currSamplesLastFFT = samplesLastFFT;
+    if (offloadActive.load()) {
+        offloadWorker.setLatency(offloadLatencySamples.load());
+        offloadWorker.process(buffer.getArrayOfWritePointers(), numInputChannels, numSamples);
+    }
+    else {
+        processVocoder(buffer.getArrayOfWritePointers(), numInputChannels, numSamples);
+    }
 
-        for (int sample = 0; sample < buffer.getNumSamples(); sample++) {
-            
-            const float in = channelData[sample];
-            channelData[sample] = outputBuffer.getSample(channel, currOutReadPos);
+    //======================================
 
-            outputBuffer.setSample(channel, currOutReadPos, 0.0f);
-            currOutReadPos++;
-            if (currOutReadPos >= outLength) currOutReadPos = 0;
+    for (int channel = getNumInputChannels(); channel < getTotalNumOutputChannels(); channel++) {
+        buffer.clear(channel, 0, buffer.getNumSamples());
+    }
+}
 
-            inputBuffer.setSample(channel, currInWritePos, in);
-            currInWritePos++;
-            if (currInWritePos >= inLength) currInWritePos = 0;
+void PitchShiftAudioProcessor::processVocoder(float* const* channels, const int numChannels, const int numSamples)
+{
+    float pitchShift = pitchShiftSlider.getNextValue();
 
-            currSamplesLastFFT++;
-            if (currSamplesLastFFT >= hopSize) {
+    // A configuration published during a switch waits in pendingVocoder,
+    // where a newer one replaces it, until the switch has finished.
+    if (fadingVocoder == nullptr) {
+        if (PhaseVocoder* nextVocoder = pendingVocoder.exchange(nullptr))
+            beginSwitch(*nextVocoder);
+    }
 
-                currSamplesLastFFT = 0;
-                int inIndex = currInWritePos;
+    if (pitchShiftSlider.isSmoothing()) resetPhases = true;
 
-                for (int index = 0; index < fftSize; ++index) {
-                    fftTimeDomain[index].real(sqrtf(fftWindow[index]) * inputBuffer.getSample(channel, inIndex));
-                    fftTimeDomain[index].imag(0.0f);
+    if (resetPhases) {
+        if (pitchShift == pitchShiftSlider.getTargetValue()) {
+            activeVocoder->resetPhases();
+            resetPhases = false;
+        }
+    }
 
-                    inIndex++;
-                    if (inIndex >= inLength) inIndex = 0;
-                }
+    //======================================
 
-                fft->perform(fftTimeDomain, fftFrequencyDomain, false);
+    float pitchShifts[PhaseVocoder::maxVoices] = { pitchShift };
+    float gains[PhaseVocoder::maxVoices] = { 1.0f };
+    int numVoices = 1;
 
-                if (pitchShiftSlider.isSmoothing()) resetPhases = true;
+    if ((bool)harmonizerButton.getTargetValue()) {
+        numVoices = (int)voicesCB.getTargetValue() + 1;
+        for (int voice = 0; voice < numVoices; voice++) {
+            pitchShifts[voice] = voiceShiftSliders[voice]->getNextValue();
+            gains[voice] = voiceGainSliders[voice]->getNextValue();
+        }
+    }
+
+    //======================================
+
+    // During a switch both engines run, in chunks that fit crossfadeBuffer.
+    const int chunkSize = crossfadeBuffer.getNumSamples();
+    float* chunkChannels[maxNumChannels];
+    jassert(numChannels <= maxNumChannels);
+
+    for (int start = 0; start < numSamples; start += chunkSize) {
+        const int numChunkSamples = jmin(chunkSize, numSamples - start);
+
+        for (int channel = 0; channel < numChannels; channel++)
+            chunkChannels[channel] = channels[channel] + start;
+
+        if (fadingVocoder != nullptr)
+            processSwitch(chunkChannels, numChannels, numChunkSamples, pitchShifts, gains, numVoices);
+        else
+            activeVocoder->process(workerPool, chunkChannels, numChannels, numChunkSamples, pitchShifts, gains, numVoices);
+    }
+}
+
+void PitchShiftAudioProcessor::beginSwitch(PhaseVocoder& nextVocoder)
+{
+    fadingVocoder = activeVocoder;
+    activeVocoder = &nextVocoder;
+
+    const int outgoingLatency = fadingVocoder->getLatencySamples();
+    const int incomingLatency = activeVocoder->getLatencySamples();
+    alignmentDelay = jmin(std::abs(incomingLatency - outgoingLatency), alignmentBuffer.getNumSamples() - 1);
+    delayIncoming = incomingLatency < outgoingLatency;
+    alignmentWritePosition = 0;
+    switchPosition = 0;
+
+    // The crossfade starts once the incoming engine, delayed where it is
+    // the shorter one, is past the silence it started from, and once the
+    // outgoing one, where it is the shorter one, is spliced into its delay.
+    const int warmup = activeVocoder->getTailLengthSamples();
+
+    if (alignmentDelay == 0)
+        switchFadeStart = warmup;
+    else if (delayIncoming)
+        switchFadeStart = warmup + alignmentDelay;
+    else
+        switchFadeStart = jmax(warmup, alignmentDelay + (int)switchSpliceLength);
+
+    switchLength = switchFadeStart + switchFadeLength;
+    if (alignmentDelay > 0 && delayIncoming)
+        switchLength += switchSpliceLength;
+
+    // The output moves to the incoming engine's latency where the shorter
+    // engine's splice starts, or right away if the latencies are equal.
+    if (alignmentDelay == 0)
+        switchLatencyPosition = 0;
+    else if (delayIncoming)
+        switchLatencyPosition = switchFadeStart + switchFadeLength;
+    else
+        switchLatencyPosition = alignmentDelay;
+}
 
-                if (resetPhases) {
-                    if (pitchShift == pitchShiftSlider.getTargetValue()) {
-                        inputPhase.clear();
-                        outputPhase.clear();
-                        resetPhases = false;
-                    }
-                }
+void PitchShiftAudioProcessor::processSwitch(float* const* channels, const int numChannels, const int numSamples,
+                                             const float* pitchShifts, const float* gains, const int numVoices)
+{
+    for (int channel = 0; channel < numChannels; channel++)
+        FloatVectorOperations::copy(crossfadeBuffer.getWritePointer(channel), channels[channel], numSamples);
 
-                for (int fftIndex = 0; fftIndex < 512; fftIndex++) {
+    fadingVocoder->process(workerPool, crossfadeBuffer.getArrayOfWritePointers(), numChannels, numSamples,
+        pitchShifts, gains, numVoices);
+    activeVocoder->process(workerPool, channels, numChannels, numSamples, pitchShifts, gains, numVoices);
+
+    //======================================
 
-                    float magnitude = abs(fftFrequencyDomain[fftIndex]);
-                    float phase = arg(fftFrequencyDomain[fftIndex]);
+    const int fadeEnd = switchFadeStart + switchFadeLength;
 
-                    float phaseDev = phase - inputPhase.getSample(channel, fftIndex) - omega[fftIndex] * (float)hopSize;
-                    float df = omega[fftIndex] * hopSize + princArg(phaseDev);
-                    float newPhase = princArg(outputPhase.getSample(channel, fftIndex) + df * ratio);
+    // Share of the incoming engine in the output.
+    auto getFadeGain = [&](const int position) {
+        return jlimit(0.0f, 1.0f, (float)(position - switchFadeStart + 1) / (float)switchFadeLength);
+    };
 
-                    inputPhase.setSample(channel, fftIndex, phase);
-                    outputPhase.setSample(channel, fftIndex, newPhase);
-                    fftFrequencyDomain[fftIndex] = std::polar(magnitude, newPhase);
-                }
+    // Share of the delayed signal in the output of the shorter engine.
+    auto getAlignment = [&](const int position) {
+        if (delayIncoming)
+            return 1.0f - jlimit(0.0f, 1.0f, (float)(position - fadeEnd + 1) / (float)switchSpliceLength);
 
-                fft->perform(fftFrequencyDomain, fftTimeDomain, true);
+        return jlimit(0.0f, 1.0f, (float)(position - alignmentDelay + 1) / (float)switchSpliceLength);
+    };
 
-                for (int fftIndex = 0; fftIndex < resampledLength; fftIndex++) {
+    const int alignmentLength = alignmentBuffer.getNumSamples();
 
-                    float x = (float)fftIndex * (float)fftSize / (float)resampledLength;
-                    int ix = (int)floorf(x);
-                    float dx = x - (float)ix;
+    for (int channel = 0; channel < numChannels; channel++) {
+        float* incomingData = channels[channel];
+        float* outgoingData = crossfadeBuffer.getWritePointer(channel);
+        float* shorterData = delayIncoming ? incomingData : outgoingData;
+        float* alignmentData = alignmentBuffer.getWritePointer(channel);
+        int writePosition = alignmentWritePosition;
 
-                    float sample1 = fftTimeDomain[ix].real();
-                    float sample2 = fftTimeDomain[(ix + 1) % fftSize].real();
-                    resampledOutput[fftIndex] = sample1 + dx * (sample2 - sample1);
-                    resampledOutput[fftIndex] *= sqrtf(synthesisWindow[fftIndex]);
-                }
+        for (int sample = 0; sample < numSamples; sample++) {
+            const int position = switchPosition + sample;
 
-                int outIndex = currOutWritePos;
-                for (int fftIndex = 0; fftIndex < resampledLength; fftIndex++) {
+            if (alignmentDelay > 0) {
+                alignmentData[writePosition] = shorterData[sample];
 
-                    float out = outputBuffer.getSample(channel, outIndex);
-                    out += resampledOutput[fftIndex] * windowScaleFactor;
-                    outputBuffer.setSample(channel, outIndex, out);
+                int readPosition = writePosition - alignmentDelay;
+                if (readPosition < 0)
+                    readPosition += alignmentLength;
 
-                    outIndex++;
-                    if (outIndex >= outLength) outIndex = 0;
-                }
+                shorterData[sample] += getAlignment(position) * (alignmentData[readPosition] - shorterData[sample]);
 
-                currOutWritePos += hopSize;
-                if (currOutWritePos >= outLength) currOutWritePos = 0;
+                if (++writePosition == alignmentLength)
+                    writePosition = 0;
             }
+
+            incomingData[sample] = outgoingData[sample] + getFadeGain(position) * (incomingData[sample] - outgoingData[sample]);
         }
     }
 
-    inWritePos = currInWritePos;
-    outWritePos = currOutWritePos;
-    outReadPos = currOutReadPos;
-    samplesLastFFT = currSamplesLastFFT;
+    if (switchPosition <= switchLatencyPosition && switchLatencyPosition < switchPosition + numSamples)
+        updateLatency(*activeVocoder);
 
-    //======================================
+    alignmentWritePosition = (alignmentWritePosition + numSamples) % alignmentLength;
+    switchPosition += numSamples;
 
-    for (int channel = getNumInputChannels(); channel < getTotalNumOutputChannels(); channel++) {
-        buffer.clear(channel, 0, buffer.getNumSamples());
+    if (switchPosition >= switchLength) {
+        vocoderInUse[fadingVocoder - vocoders].store(false);
+        fadingVocoder = nullptr;
     }
 }
 
-//==============================================================================
+void PitchShiftAudioProcessor::processOffloaded(float* const* channels, const int numChannels, const int numSamples)
+{
+    processVocoder(channels, numChannels, numSamples);
+}
 
-void PitchShiftAudioProcessor::updateFftSize()
+int PitchShiftAudioProcessor::getGrainSize(const double sampleRate) const
 {
-    fftSize = 512;
-    fft = std::make_unique<dsp::FFT>(log2(fftSize));
+    const double grainTime = 2.5e-3;
+    return nextPowerOfTwo(roundToInt(sampleRate * grainTime));
+}
 
-    inLength = fftSize;
-    inWritePos = 0;
-    inputBuffer.clear();
-    inputBuffer.setSize(getTotalNumInputChannels(), inLength);
+OfflineRenderer::Settings PitchShiftAudioProcessor::getOfflineRenderSettings() const
+{
+    OfflineRenderer::Settings settings;
+    settings.engine = (int)engineCB->getTargetValue();
+    settings.fftSize = (int)fftSizeCB.getTargetValue();
+    settings.overlap = (int)hopSizeCB.getTargetValue();
+    settings.windowType = (int)windowTypeCB.getTargetValue();
+    settings.resamplerQuality = (int)resamplerQualityCB.getTargetValue();
+    settings.grainSize = getGrainSize(getSampleRate());
+    settings.minRatio = powf(2.0f, pitchShiftSlider.minValue / 12.0f);
+
+    if ((bool)harmonizerButton.getTargetValue()) {
+        settings.numVoices = (int)voicesCB.getTargetValue() + 1;
+        for (int voice = 0; voice < settings.numVoices; voice++) {
+            settings.pitchShifts[voice] = voiceShiftSliders[voice]->getTargetValue();
+            settings.gains[voice] = voiceGainSliders[voice]->getTargetValue();
+        }
+    }
+    else {
+        settings.pitchShifts[0] = pitchShiftSlider.getTargetValue();
+    }
 
-    float maxRatio = powf(2.0f, pitchShiftSlider.minValue / 12.0f);
-    outLength = (int)floorf((float)fftSize / maxRatio);
-    outWritePos = 0;
-    outReadPos = 0;
-    outputBuffer.clear();
-    outputBuffer.setSize(getTotalNumInputChannels(), outLength);
+    return settings;
+}
 
-    fftWindow.realloc(fftSize);
-    fftWindow.clear(fftSize);
+//==============================================================================
 
-    fftTimeDomain.realloc(fftSize);
-    fftTimeDomain.clear(fftSize);
+void PitchShiftAudioProcessor::requestVocoderUpdate()
+{
+    vocoderUpdateRequested.store(true);
+    triggerAsyncUpdate();
+}
+
+void PitchShiftAudioProcessor::updateVocoder()
+{
+    const ScopedLock sl(configurationLock);
 
-    fftFrequencyDomain.realloc(fftSize);
-    fftFrequencyDomain.clear(fftSize);
+    if (! vocodersPrepared)
+        return;
 
-    samplesLastFFT = 0;
+    PhaseVocoder* vocoder = pendingVocoder.exchange(nullptr);
 
-    omega.realloc(fftSize);
-    for (int index = 0; index < fftSize; ++index) {
-        omega[index] = 2.0f * M_PI * index / (float)fftSize;
+    if (vocoder == nullptr) {
+        for (int index = 0; index < numVocoders; index++) {
+            if (! vocoderInUse[index].load()) {
+                vocoderInUse[index].store(true);
+                vocoder = &vocoders[index];
+                break;
+            }
+        }
     }
 
-    inputPhase.clear();
-    inputPhase.setSize(getTotalNumInputChannels(), outLength);
+    jassert(vocoder != nullptr);
 
-    outputPhase.clear();
-    outputPhase.setSize(getTotalNumInputChannels(), outLength);
+    vocoder->setConfiguration((int)engineCB->getTargetValue(),
+        (int)fftSizeCB.getTargetValue(),
+        (int)hopSizeCB.getTargetValue(),
+        (int)windowTypeCB.getTargetValue(),
+        (int)resamplerQualityCB.getTargetValue());
+    vocoder->prepareRatio(pitchShiftSlider.getTargetValue());
+    pendingVocoder.store(vocoder);
 }
 
-void PitchShiftAudioProcessor::updateHopSize()
+void PitchShiftAudioProcessor::updateLatency(const PhaseVocoder& vocoder)
 {
-    overlap = (int)hopSizeCB.getTargetValue();
-    if (overlap != 0) {
-        hopSize = fftSize / overlap;
-        outWritePos = hopSize % outLength;
-    }
+    tailLengthSamples.store(vocoder.getTailLengthSamples());
+    vocoderLatencySamples.store(vocoder.getLatencySamples());
+    offloadLatencySamples.store(vocoder.getHopSize() + jmax(0, maxBlockSize - 1));
+    reportLatency();
 }
 
-void PitchShiftAudioProcessor::updateWindowScaleFactor()
+void PitchShiftAudioProcessor::reportLatency()
 {
-    float windowSum = 0.0f;
-    for (int sample = 0; sample < fftSize; ++sample)
-        windowSum += fftWindow[sample];
+    triggerAsyncUpdate();
+}
 
-    windowScaleFactor = 0.0f;
-    if (overlap != 0 && windowSum != 0.0f)
-        windowScaleFactor = 1.0f / (float)overlap / windowSum * (float)fftSize;
+int PitchShiftAudioProcessor::getReportedLatency() const
+{
+    const int offloadLatency = offloadActive.load() ? offloadLatencySamples.load() : 0;
+    return vocoderLatencySamples.load() + offloadLatency;
 }
 
-float PitchShiftAudioProcessor::princArg(const float phase)
+void PitchShiftAudioProcessor::handleAsyncUpdate()
 {
-    if (phase >= 0.0f) return fmod(phase + M_PI, 2.0f * M_PI) - M_PI;
-    else return fmod(phase + M_PI, -2.0f * M_PI) + M_PI;
+    if (vocoderUpdateRequested.exchange(false))
+        updateVocoder();
+
+    setLatencySamples(getReportedLatency());
 }
 
 //==============================================================================
@@ -324,9 +480,10 @@ bool PitchShiftAudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts
     return true;
 #else
     // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    if (layouts.getMainOutputChannelSet() != AudioChannelSet::mono()
-        && layouts.getMainOutputChannelSet() != AudioChannelSet::stereo())
+    // Channels are processed independently, so any discrete layout up to
+    // maxNumChannels is accepted (mono, stereo, surround and stem buses).
+    const int numChannels = layouts.getMainOutputChannelSet().size();
+    if (numChannels < 1 || numChannels > maxNumChannels)
         return false;
 
     // This checks if the input layout matches the output layout
@@ -376,7 +533,8 @@ bool PitchShiftAudioProcessor::isMidiEffect() const
 
 double PitchShiftAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    const double sampleRate = getSampleRate();
+    return sampleRate > 0.0 ? (double)tailLengthSamples.load() / sampleRate : 0.0;
 }
 
 //==============================================================================
@@ -5,10 +5,13 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "PluginParameter.h"
+#include "PhaseVocoder.h"
+#include "OffloadWorker.h"
+#include "OfflineRenderer.h"
 
 //==============================================================================
 
-class PitchShiftAudioProcessor : public AudioProcessor
+class PitchShiftAudioProcessor : public AudioProcessor, private OffloadWorker::Client, private AsyncUpdater
 {
 public:
     //==============================================================================
@@ -61,6 +64,18 @@ public:
 
     //==============================================================================
 
+    StringArray engineItemsUI = {
+        "Phase vocoder",
+        "Low latency",
+    };
+
+    enum engineIndex {
+        enginePhaseVocoder = 0,
+        engineLowLatency,
+    };
+
+    //======================================
+
     StringArray fftSizeItemsUI = {
         "32",
         "64",
@@ -115,45 +130,112 @@ public:
 
     //======================================
 
-    void updateFftSize();
-    void updateHopSize();
-    void updateWindowScaleFactor();
+    StringArray resamplerQualityItemsUI = {
+        "Linear",
+        "Sinc (8 taps)",
+        "Sinc (16 taps)",
+    };
 
-    float princArg(const float phase);
+    enum resamplerQualityIndex {
+        resamplerQualityLinear = 0,
+        resamplerQualitySinc8,
+        resamplerQualitySinc16,
+    };
 
     //======================================
 
-    CriticalSection lock;
-
-    int fftSize;
-    std::unique_ptr<dsp::FFT> fft;
-
-    int inLength;
-    int inWritePos;
-    AudioSampleBuffer inputBuffer;
-
-    int outLength;
-    int outWritePos;
-    int outReadPos;
-    AudioSampleBuffer outputBuffer;
-
-    HeapBlock<float> fftWindow;
-    HeapBlock<dsp::Complex<float>> fftTimeDomain;
-    HeapBlock<dsp::Complex<float>> fftFrequencyDomain;
-
-    int samplesLastFFT;
-
-    int overlap;
-    int hopSize;
-    float windowScaleFactor;
+    StringArray voicesItemsUI = {
+        "1",
+        "2",
+        "3",
+        "4",
+        "5",
+        "6",
+        "7",
+        "8",
+    };
 
     //======================================
 
-    HeapBlock<float> omega;
-    AudioSampleBuffer inputPhase;
-    AudioSampleBuffer outputPhase;
+    /*
+        Reconfiguration never touches the engine the audio thread is using.
+        The parameter callbacks, which hosts may call on the audio thread,
+        only request it; updateVocoder() then runs on the message thread,
+        configures a spare engine and publishes it through pendingVocoder.
+        processVocoder picks it up when no switch is running and feeds it
+        alongside the old one, which stays audible until the new one has run
+        for its tail length and so no longer plays the silence it was
+        cleared to. Then it crossfades over switchFadeLength samples and
+        hands the old one back by clearing its vocoderInUse flag. Three
+        engines cover active + fading + pending.
+
+        The engine with the shorter latency plays through alignmentBuffer,
+        delayed by the difference, so the two are mixed in time. It is
+        spliced into or out of that delay over switchSpliceLength samples
+        while it plays alone: the outgoing one before the crossfade, the
+        incoming one after it. The new latency is reported where that splice
+        starts, when the output actually moves to it, and not when the
+        engine is published.
+    */
+
+    enum {
+        numVocoders = 3,
+        maxNumChannels = 8,
+        switchFadeLength = 2048,
+        switchSpliceLength = 256,
+    };
+
+    void requestVocoderUpdate();
+    void updateVocoder();
+    void updateLatency(const PhaseVocoder& vocoder);
+
+    // The latency changes on the audio thread when offloading is switched,
+    // so it is posted to the message thread rather than set from there,
+    // along with any requested reconfiguration.
+    void reportLatency();
+    int getReportedLatency() const;
+    void handleAsyncUpdate() override;
+
+    void processVocoder(float* const* channels, int numChannels, int numSamples);
+    void beginSwitch(PhaseVocoder& nextVocoder);
+    void processSwitch(float* const* channels, int numChannels, int numSamples,
+                       const float* pitchShifts, const float* gains, int numVoices);
+    void processOffloaded(float* const* channels, int numChannels, int numSamples) override;
+
+    int getGrainSize(double sampleRate) const;
+
+    // Current parameter targets, for rendering whole buffers or files with
+    // OfflineRenderer instead of block by block.
+    OfflineRenderer::Settings getOfflineRenderSettings() const;
+
+    CriticalSection configurationLock;
+
+    PhaseVocoder vocoders[numVocoders];
+    std::atomic<bool> vocoderInUse[numVocoders];
+    std::atomic<PhaseVocoder*> pendingVocoder { nullptr };
+    std::atomic<bool> vocodersPrepared { false };
+    std::atomic<bool> vocoderUpdateRequested { false };
+    std::atomic<int> tailLengthSamples { 0 };
+    std::atomic<int> vocoderLatencySamples { 0 };
+    std::atomic<int> offloadLatencySamples { 0 };
+    PhaseVocoder* activeVocoder = nullptr;
+
+    PhaseVocoder* fadingVocoder = nullptr;
+    AudioSampleBuffer crossfadeBuffer;
+    AudioSampleBuffer alignmentBuffer;
+    int alignmentDelay = 0;
+    int alignmentWritePosition = 0;
+    bool delayIncoming = false;
+    int switchPosition = 0;
+    int switchFadeStart = 0;
+    int switchLength = 0;
+    int switchLatencyPosition = 0;
+    ChannelWorkerPool workerPool;
     bool resetPhases;
 
+    std::atomic<bool> offloadActive { false };
+    int maxBlockSize = 0;
+
     //======================================
 
     PluginParametersManager ppManager;
@@ -163,6 +245,33 @@ public:
     PluginParameterComboBox fftSizeCB;
     PluginParameterComboBox hopSizeCB;
     PluginParameterComboBox windowTypeCB;
+    PluginParameterComboBox resamplerQualityCB;
+    PluginParameterToggle offloadButton;
+
+    PluginParameterToggle harmonizerButton;
+    PluginParameterComboBox voicesCB;
+    OwnedArray<PluginParameterLinSlider> voiceShiftSliders;
+    OwnedArray<PluginParameterLinSlider> voiceGainSliders;
+
+    // Created after the parameters that predate it, so that theirs keep
+    // their indices for saved automation.
+    std::unique_ptr<PluginParameterComboBox> engineCB;
+
+    //======================================
+
+    /*
+        In offload mode processBlock only moves audio through the FIFOs of
+        offloadWorker, whose thread runs processVocoder one hop ahead. The
+        mode is switched on the audio thread without waiting: switching off
+        keeps the worker's output until it has stopped, and only then does
+        processVocoder run inline again.
+
+        The worker reads the parameters and engines above, so it is declared
+        after them and destroyed first; releaseResources() and the destructor
+        also join its thread explicitly.
+    */
+
+    OffloadWorker offloadWorker;
 
 private:
     //==============================================================================
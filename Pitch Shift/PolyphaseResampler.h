@@ -0,0 +1,141 @@
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "VocoderKernel.h"
+
+//==============================================================================
+
+/*
+    Read-only tables for the polyphase windowed-sinc resampler, shared by every
+    plugin instance through a SharedResourcePointer. They hold a finely sampled
+    sinc and half a Blackman window, so the per-ratio kernels can be built on
+    the audio thread with table lookups only: each kernel is the sinc at the
+    ratio's cutoff, windowed over the tap span, for numPhases + 1 evenly
+    spaced fractional read positions, and every phase is normalized to unity
+    gain. Interpolating a sample is then one dot product of numTaps frame
+    samples with one kernel phase, four taps at a time on SSE2.
+*/
+
+class PolyphaseResampler
+{
+public:
+    //==============================================================================
+
+    enum quality {
+        qualityLinear = 0,
+        qualitySinc8,
+        qualitySinc16,
+        numQualities,
+    };
+
+    enum {
+        maxTaps = 16,
+        padding = maxTaps / 2,
+        numPhases = 128,
+        kernelSize = (numPhases + 1) * maxTaps,
+        tableOversampling = 512,
+        sincTableSize = (maxTaps / 2 + 1) * tableOversampling,
+        windowTableSize = 4096,
+    };
+
+    //==============================================================================
+
+    PolyphaseResampler()
+    {
+        sincTable.malloc(sincTableSize + 1);
+        for (int index = 0; index <= sincTableSize; index++) {
+            const double x = M_PI * (double)index / (double)tableOversampling;
+            sincTable[index] = index == 0 ? 1.0f : (float)(sin(x) / x);
+        }
+
+        windowTable.malloc(windowTableSize + 1);
+        for (int index = 0; index <= windowTableSize; index++) {
+            const double x = M_PI * (double)index / (double)windowTableSize;
+            windowTable[index] = (float)(0.42 + 0.5 * cos(x) + 0.08 * cos(2.0 * x));
+        }
+    }
+
+    //==============================================================================
+
+    static int getNumTaps(const int qualityIndex)
+    {
+        switch (qualityIndex) {
+        case qualitySinc16:
+            return 16;
+        case qualitySinc8:
+            return 8;
+        case qualityLinear:
+        default:
+            return 2;
+        }
+    }
+
+    void fillKernels(float* kernels, const int numTaps, const float cutoff) const
+    {
+        const int halfTaps = numTaps / 2;
+
+        for (int phase = 0; phase <= numPhases; phase++) {
+            float* kernel = kernels + phase * numTaps;
+            const float fraction = (float)phase / (float)numPhases;
+            float sum = 0.0f;
+
+            for (int tap = 0; tap < numTaps; tap++) {
+                const float distance = fabsf((float)(tap - halfTaps + 1) - fraction);
+                const float value = distance >= (float)halfTaps ? 0.0f
+                    : cutoff * lookup(sincTable, cutoff * distance * (float)tableOversampling, sincTableSize)
+                        * lookup(windowTable, distance / (float)halfTaps * (float)windowTableSize, windowTableSize);
+
+                kernel[tap] = value;
+                sum += value;
+            }
+
+            for (int tap = 0; tap < numTaps; tap++)
+                kernel[tap] /= sum;
+        }
+    }
+
+    //==============================================================================
+
+    static float interpolate(const float* input, const float* kernel, const int numTaps)
+    {
+#if PITCHSHIFT_VOCODER_SSE2
+        __m128 sum = _mm_mul_ps(_mm_loadu_ps(input), _mm_loadu_ps(kernel));
+        for (int tap = 4; tap < numTaps; tap += 4)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(input + tap), _mm_loadu_ps(kernel + tap)));
+
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(sum);
+#else
+        float sum = 0.0f;
+        for (int tap = 0; tap < numTaps; tap++)
+            sum += input[tap] * kernel[tap];
+
+        return sum;
+#endif
+    }
+
+private:
+    //==============================================================================
+
+    static float lookup(const float* table, const float position, const int size)
+    {
+        const int index = jmin((int)position, size - 1);
+        const float fraction = jmin(position - (float)index, 1.0f);
+        return table[index] + fraction * (table[index + 1] - table[index]);
+    }
+
+    //==============================================================================
+
+    HeapBlock<float> sincTable;
+    HeapBlock<float> windowTable;
+
+    //==============================================================================
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PolyphaseResampler)
+};
+
+//==============================================================================
@@ -0,0 +1,316 @@
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_USE_SIMD && defined (__SSE2__)
+ #include <emmintrin.h>
+ #define PITCHSHIFT_VOCODER_SSE2 1
+#else
+ #define PITCHSHIFT_VOCODER_SSE2 0
+#endif
+
+//==============================================================================
+
+/*
+    Phase-vocoder bin kernel. For every bin it measures magnitude and phase,
+    derives the true frequency from the phase advance since the last frame,
+    accumulates the shifted output phase and writes the bin back in polar form.
+
+    The transcendental calls are replaced by bounded-error approximations:
+    atan2 uses a 9th-order minimax polynomial (|error| < 1.5e-5 rad), sin/cos
+    use odd/even polynomials on [-pi/2, pi/2] after a quadrant fold
+    (|error| < 1.0e-6), and phases are wrapped branch-free with a round to
+    nearest multiple of 2 pi instead of fmod. On SSE2 four bins are processed
+    per step; the remaining bins, and builds without SSE2, take the scalar
+    path, which uses the same approximations so the results do not depend on
+    where the vector loop stops.
+
+    analyse() and synthesise() are the two halves of process() for when one
+    analysis feeds several voices: analyse() leaves the magnitude and the
+    true phase advance per hop of every bin, and synthesise() accumulates one
+    voice's output phase from them and writes that voice's bins.
+    accumulate() only advances the output phase, for when the bins are not
+    needed.
+*/
+
+struct VocoderKernel
+{
+    //==============================================================================
+
+    static void process(float* bins,
+        float* inputPhase,
+        float* outputPhase,
+        const float* binAdvance,
+        const int numBins,
+        const float ratio)
+    {
+        int bin = 0;
+
+#if PITCHSHIFT_VOCODER_SSE2
+        const __m128 ratio4 = _mm_set1_ps(ratio);
+
+        for (; bin + 4 <= numBins; bin += 4) {
+            __m128 lo = _mm_loadu_ps(bins + 2 * bin);
+            __m128 hi = _mm_loadu_ps(bins + 2 * bin + 4);
+            __m128 re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+
+            __m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im)));
+            __m128 phase = fastAtan2(im, re);
+
+            __m128 advance = _mm_loadu_ps(binAdvance + bin);
+            __m128 phaseDev = _mm_sub_ps(_mm_sub_ps(phase, _mm_loadu_ps(inputPhase + bin)), advance);
+            __m128 df = _mm_add_ps(advance, wrapPhase(phaseDev));
+            __m128 newPhase = wrapPhase(_mm_add_ps(_mm_loadu_ps(outputPhase + bin), _mm_mul_ps(df, ratio4)));
+
+            _mm_storeu_ps(inputPhase + bin, phase);
+            _mm_storeu_ps(outputPhase + bin, newPhase);
+
+            __m128 sine, cosine;
+            fastSinCos(newPhase, sine, cosine);
+            re = _mm_mul_ps(magnitude, cosine);
+            im = _mm_mul_ps(magnitude, sine);
+
+            _mm_storeu_ps(bins + 2 * bin, _mm_unpacklo_ps(re, im));
+            _mm_storeu_ps(bins + 2 * bin + 4, _mm_unpackhi_ps(re, im));
+        }
+#endif
+
+        for (; bin < numBins; bin++) {
+            const float re = bins[2 * bin];
+            const float im = bins[2 * bin + 1];
+
+            float magnitude = sqrtf(re * re + im * im);
+            float phase = fastAtan2(im, re);
+
+            float phaseDev = phase - inputPhase[bin] - binAdvance[bin];
+            float df = binAdvance[bin] + wrapPhase(phaseDev);
+            float newPhase = wrapPhase(outputPhase[bin] + df * ratio);
+
+            inputPhase[bin] = phase;
+            outputPhase[bin] = newPhase;
+
+            float sine, cosine;
+            fastSinCos(newPhase, sine, cosine);
+            bins[2 * bin] = magnitude * cosine;
+            bins[2 * bin + 1] = magnitude * sine;
+        }
+    }
+
+    static void analyse(const float* bins,
+        float* inputPhase,
+        const float* binAdvance,
+        const int numBins,
+        float* magnitude,
+        float* frequency)
+    {
+        int bin = 0;
+
+#if PITCHSHIFT_VOCODER_SSE2
+        for (; bin + 4 <= numBins; bin += 4) {
+            __m128 lo = _mm_loadu_ps(bins + 2 * bin);
+            __m128 hi = _mm_loadu_ps(bins + 2 * bin + 4);
+            __m128 re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+
+            __m128 phase = fastAtan2(im, re);
+            __m128 advance = _mm_loadu_ps(binAdvance + bin);
+            __m128 phaseDev = _mm_sub_ps(_mm_sub_ps(phase, _mm_loadu_ps(inputPhase + bin)), advance);
+
+            _mm_storeu_ps(magnitude + bin, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im))));
+            _mm_storeu_ps(frequency + bin, _mm_add_ps(advance, wrapPhase(phaseDev)));
+            _mm_storeu_ps(inputPhase + bin, phase);
+        }
+#endif
+
+        for (; bin < numBins; bin++) {
+            const float re = bins[2 * bin];
+            const float im = bins[2 * bin + 1];
+
+            float phase = fastAtan2(im, re);
+            float phaseDev = phase - inputPhase[bin] - binAdvance[bin];
+
+            magnitude[bin] = sqrtf(re * re + im * im);
+            frequency[bin] = binAdvance[bin] + wrapPhase(phaseDev);
+            inputPhase[bin] = phase;
+        }
+    }
+
+    static void synthesise(float* bins,
+        const float* magnitude,
+        const float* frequency,
+        float* outputPhase,
+        const int numBins,
+        const float ratio)
+    {
+        int bin = 0;
+
+#if PITCHSHIFT_VOCODER_SSE2
+        const __m128 ratio4 = _mm_set1_ps(ratio);
+
+        for (; bin + 4 <= numBins; bin += 4) {
+            __m128 df = _mm_loadu_ps(frequency + bin);
+            __m128 newPhase = wrapPhase(_mm_add_ps(_mm_loadu_ps(outputPhase + bin), _mm_mul_ps(df, ratio4)));
+            _mm_storeu_ps(outputPhase + bin, newPhase);
+
+            __m128 sine, cosine;
+            fastSinCos(newPhase, sine, cosine);
+            __m128 mag = _mm_loadu_ps(magnitude + bin);
+            __m128 re = _mm_mul_ps(mag, cosine);
+            __m128 im = _mm_mul_ps(mag, sine);
+
+            _mm_storeu_ps(bins + 2 * bin, _mm_unpacklo_ps(re, im));
+            _mm_storeu_ps(bins + 2 * bin + 4, _mm_unpackhi_ps(re, im));
+        }
+#endif
+
+        for (; bin < numBins; bin++) {
+            float newPhase = wrapPhase(outputPhase[bin] + frequency[bin] * ratio);
+            outputPhase[bin] = newPhase;
+
+            float sine, cosine;
+            fastSinCos(newPhase, sine, cosine);
+            bins[2 * bin] = magnitude[bin] * cosine;
+            bins[2 * bin + 1] = magnitude[bin] * sine;
+        }
+    }
+
+    static void accumulate(float* outputPhase,
+        const float* frequency,
+        const int numBins,
+        const float ratio)
+    {
+        int bin = 0;
+
+#if PITCHSHIFT_VOCODER_SSE2
+        const __m128 ratio4 = _mm_set1_ps(ratio);
+
+        for (; bin + 4 <= numBins; bin += 4) {
+            __m128 df = _mm_loadu_ps(frequency + bin);
+            _mm_storeu_ps(outputPhase + bin, wrapPhase(_mm_add_ps(_mm_loadu_ps(outputPhase + bin), _mm_mul_ps(df, ratio4))));
+        }
+#endif
+
+        for (; bin < numBins; bin++)
+            outputPhase[bin] = wrapPhase(outputPhase[bin] + frequency[bin] * ratio);
+    }
+
+    //==============================================================================
+
+    static float wrapPhase(const float phase)
+    {
+        return phase - twoPi * (float)roundToInt(phase * inverseTwoPi);
+    }
+
+    static float fastAtan2(const float y, const float x)
+    {
+        const float absX = fabsf(x);
+        const float absY = fabsf(y);
+        const float largest = absX > absY ? absX : absY;
+        const float a = (absX < absY ? absX : absY) / (largest > tiny ? largest : tiny);
+        const float s = a * a;
+
+        float r = ((((atanC9 * s + atanC7) * s + atanC5) * s + atanC3) * s + atanC1) * a;
+        if (absY > absX) r = halfPi - r;
+        if (x < 0.0f) r = pi - r;
+        return y < 0.0f ? -r : r;
+    }
+
+    static void fastSinCos(const float phase, float& sine, float& cosine)
+    {
+        const float folded = phase > halfPi ? pi - phase : (phase < -halfPi ? -pi - phase : phase);
+        const float cosineSign = (phase > halfPi || phase < -halfPi) ? -1.0f : 1.0f;
+        const float x2 = folded * folded;
+
+        sine = folded * (1.0f + x2 * (sinC3 + x2 * (sinC5 + x2 * (sinC7 + x2 * (sinC9 + x2 * sinC11)))));
+        cosine = cosineSign * (1.0f + x2 * (cosC2 + x2 * (cosC4 + x2 * (cosC6 + x2 * (cosC8 + x2 * cosC10)))));
+    }
+
+#if PITCHSHIFT_VOCODER_SSE2
+    static __m128 wrapPhase(const __m128 phase)
+    {
+        __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(phase, _mm_set1_ps(inverseTwoPi))));
+        return _mm_sub_ps(phase, _mm_mul_ps(turns, _mm_set1_ps(twoPi)));
+    }
+
+    static __m128 fastAtan2(const __m128 y, const __m128 x)
+    {
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        const __m128 absX = _mm_andnot_ps(signMask, x);
+        const __m128 absY = _mm_andnot_ps(signMask, y);
+
+        const __m128 a = _mm_div_ps(_mm_min_ps(absX, absY), _mm_max_ps(_mm_max_ps(absX, absY), _mm_set1_ps(tiny)));
+        const __m128 s = _mm_mul_ps(a, a);
+
+        __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(atanC9), s), _mm_set1_ps(atanC7));
+        r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(atanC5));
+        r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(atanC3));
+        r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(atanC1));
+        r = _mm_mul_ps(r, a);
+
+        const __m128 steep = _mm_cmpgt_ps(absY, absX);
+        r = _mm_or_ps(_mm_and_ps(steep, _mm_sub_ps(_mm_set1_ps(halfPi), r)), _mm_andnot_ps(steep, r));
+
+        const __m128 negativeX = _mm_cmplt_ps(x, _mm_setzero_ps());
+        r = _mm_or_ps(_mm_and_ps(negativeX, _mm_sub_ps(_mm_set1_ps(pi), r)), _mm_andnot_ps(negativeX, r));
+
+        return _mm_xor_ps(r, _mm_and_ps(y, signMask));
+    }
+
+    static void fastSinCos(const __m128 phase, __m128& sine, __m128& cosine)
+    {
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        const __m128 phaseSign = _mm_and_ps(phase, signMask);
+        const __m128 outside = _mm_cmpgt_ps(_mm_andnot_ps(signMask, phase), _mm_set1_ps(halfPi));
+
+        const __m128 mirrored = _mm_sub_ps(_mm_or_ps(_mm_set1_ps(pi), phaseSign), phase);
+        const __m128 folded = _mm_or_ps(_mm_and_ps(outside, mirrored), _mm_andnot_ps(outside, phase));
+        const __m128 x2 = _mm_mul_ps(folded, folded);
+
+        __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(sinC11), x2), _mm_set1_ps(sinC9));
+        s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(sinC7));
+        s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(sinC5));
+        s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(sinC3));
+        s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(1.0f));
+        sine = _mm_mul_ps(s, folded);
+
+        __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(cosC10), x2), _mm_set1_ps(cosC8));
+        c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(cosC6));
+        c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(cosC4));
+        c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(cosC2));
+        c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(1.0f));
+        cosine = _mm_xor_ps(c, _mm_and_ps(outside, signMask));
+    }
+#endif
+
+    //==============================================================================
+
+    static constexpr float pi = 3.14159265358979f;
+    static constexpr float halfPi = 1.57079632679490f;
+    static constexpr float twoPi = 6.28318530717959f;
+    static constexpr float inverseTwoPi = 0.159154943091895f;
+    static constexpr float tiny = 1.0e-30f;
+
+    static constexpr float atanC1 = 0.9998660f;
+    static constexpr float atanC3 = -0.3302995f;
+    static constexpr float atanC5 = 0.1801410f;
+    static constexpr float atanC7 = -0.0851330f;
+    static constexpr float atanC9 = 0.0208351f;
+
+    static constexpr float sinC3 = -1.0f / 6.0f;
+    static constexpr float sinC5 = 1.0f / 120.0f;
+    static constexpr float sinC7 = -1.0f / 5040.0f;
+    static constexpr float sinC9 = 1.0f / 362880.0f;
+    static constexpr float sinC11 = -1.0f / 39916800.0f;
+
+    static constexpr float cosC2 = -1.0f / 2.0f;
+    static constexpr float cosC4 = 1.0f / 24.0f;
+    static constexpr float cosC6 = -1.0f / 720.0f;
+    static constexpr float cosC8 = 1.0f / 40320.0f;
+    static constexpr float cosC10 = -1.0f / 3628800.0f;
+};
+
+//==============================================================================
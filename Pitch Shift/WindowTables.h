@@ -0,0 +1,110 @@
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/*
+    Read-only window tables shared by every plugin instance in the process
+    through a SharedResourcePointer. For each window type and each supported
+    FFT size it holds the square-root analysis window and the window sum used
+    for the overlap-add scale. For each type it also holds a finely sampled
+    square-root prototype that the synthesis side stretches to any resampled
+    frame length.
+*/
+
+class WindowTables
+{
+public:
+    //==============================================================================
+
+    enum windowType {
+        windowTypeBartlett = 0,
+        windowTypeHann,
+        windowTypeHamming,
+        numWindowTypes,
+    };
+
+    enum {
+        minFftOrder = 5,
+        maxFftOrder = 13,
+        numFftOrders = maxFftOrder - minFftOrder + 1,
+        prototypeSize = 2 << maxFftOrder,
+    };
+
+    //==============================================================================
+
+    WindowTables()
+    {
+        for (int type = 0; type < numWindowTypes; type++) {
+
+            for (int order = minFftOrder; order <= maxFftOrder; order++) {
+                const int size = 1 << order;
+                HeapBlock<float>& window = analysisWindows[type][order - minFftOrder];
+                window.malloc(size);
+
+                double sum = 0.0;
+                for (int sample = 0; sample < size; sample++) {
+                    const float value = getWindowValue(type, (float)sample / (float)(size - 1));
+                    window[sample] = sqrtf(value);
+                    sum += value;
+                }
+
+                windowSums[type][order - minFftOrder] = (float)sum;
+            }
+
+            synthesisPrototypes[type].malloc(prototypeSize + 1);
+            for (int index = 0; index <= prototypeSize; index++) {
+                synthesisPrototypes[type][index] = sqrtf(getWindowValue(type, (float)index / (float)prototypeSize));
+            }
+        }
+    }
+
+    //==============================================================================
+
+    const float* getAnalysisWindow(const int type, const int fftOrder) const
+    {
+        return analysisWindows[jlimit(0, numWindowTypes - 1, type)][fftOrder - minFftOrder];
+    }
+
+    const float* getSynthesisPrototype(const int type) const
+    {
+        return synthesisPrototypes[jlimit(0, numWindowTypes - 1, type)];
+    }
+
+    float getWindowSum(const int type, const int fftOrder) const
+    {
+        return windowSums[jlimit(0, numWindowTypes - 1, type)][fftOrder - minFftOrder];
+    }
+
+    //==============================================================================
+
+    static float getWindowValue(const int type, const float position)
+    {
+        switch (type) {
+        case windowTypeHann:
+            return 0.5f - 0.5f * cosf(2.0f * M_PI * position);
+        case windowTypeHamming:
+            return 0.54f - 0.46f * cosf(2.0f * M_PI * position);
+        case windowTypeBartlett:
+        default:
+            return 1.0f - fabs(2.0f * position - 1.0f);
+        }
+    }
+
+private:
+    //==============================================================================
+
+    HeapBlock<float> analysisWindows[numWindowTypes][numFftOrders];
+    HeapBlock<float> synthesisPrototypes[numWindowTypes];
+    float windowSums[numWindowTypes][numFftOrders];
+
+    //==============================================================================
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WindowTables)
+};
+
+//==============================================================================
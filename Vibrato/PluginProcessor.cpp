@@ -19,6 +19,10 @@ VibratoAudioProcessor::VibratoAudioProcessor() :
     , widthSlider(ppManager, "Width", "ms", 1.0f, 50.0f, 10.0f, [](float value) { return value * 0.001f; })
     , freqSlider(ppManager, "LFO Frequency", "Hz", 0.0f, 10.0f, 2.0f)
     , paramWaveform(ppManager, "LFO Waveform", waveformUI, waveformSine)
+    , syncButton(ppManager, "Tempo sync", false)
+    , syncBox(ppManager, "Sync rate", syncUI, syncQuarter)
+    , paramInterpolation(ppManager, "Interpolation", interpolationUI, interpolationCubic)
+    , phaseOffsetSlider(ppManager, "Channel phase offset", "deg", 0.0f, 180.0f, 0.0f, [](float value) { return value / 360.0f; })
 {
     ppManager.valueTreeState.state = ValueTree(Identifier(getName().removeCharacters("- ")));
 }
@@ -35,21 +39,29 @@ void VibratoAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock
     widthSlider.reset(sampleRate, smoothTime);
     freqSlider.reset(sampleRate, smoothTime);
     paramWaveform.reset(sampleRate, smoothTime);
+    syncButton.reset(sampleRate, smoothTime);
+    syncBox.reset(sampleRate, smoothTime);
+    paramInterpolation.reset(sampleRate, smoothTime);
+    phaseOffsetSlider.reset(sampleRate, smoothTime);
 
     //======================================
 
+    // Four samples of headroom: the SIMD kernels write a group of four
+    // inputs before reading any of its outputs.
     float maxDelayTime = widthSlider.maxValue;
-    delaySamples = (int)(maxDelayTime * (float)sampleRate) + 1;
+    delayLine.setSize(getTotalNumInputChannels(), (int)(maxDelayTime * (float)sampleRate) + delayLine.minDelay + 1 + 4);
+    allpassStates.calloc(jmax(1, getTotalNumInputChannels()));
+    // One row of delays per input channel and one to crossfade waveforms in.
+    lfoBuffer.setSize(jmax(1, getTotalNumInputChannels()) + 1, jmax(1, samplesPerBlock));
 
-    if (delaySamples < 1) delaySamples = 1;
-
-    delayChannels = getTotalNumInputChannels();
-    delayBuffer.setSize(delayChannels, delaySamples);
-    delayBuffer.clear();
-
-    delayWritePos = 0;
     inverseSR = 1.0f / (float)sampleRate;
     lfoPhase = 0.0f;
+    currentWaveform = (int)paramWaveform.getTargetValue();
+    fadeWaveform = currentWaveform;
+    fadeStart = 0;
+    fadeLocked = false;
+    freeRunningPosition = 0;
+    currentInterpolation = (int)paramInterpolation.getTargetValue();
 }
 
 void VibratoAudioProcessor::releaseResources()
@@ -67,46 +79,152 @@ void VibratoAudioProcessor::processBlock(AudioSampleBuffer& buffer, MidiBuffer&
     //======================================
 
     float currFrequency = freqSlider.getNextValue();
-    float currWidth = widthSlider.getNextValue();
-
-    int currWritePos;
-    float phase;
-
-    for (int channel = 0; channel < numInputChannels; channel++) {
-
-        float* channelData = buffer.getWritePointer(channel);
-        float* delayData = delayBuffer.getWritePointer(channel);
-
-        currWritePos = delayWritePos;
-        phase = lfoPhase;
-
-        for (int sample = 0; sample < numSamples; ++sample) {
-
-            const float input = channelData[sample];
-            float output = 0.0f;
-
-            float readPosition = fmodf((float)currWritePos - currWidth * lfo(phase, (int)paramWaveform.getTargetValue()) * (float)getSampleRate() + (float)delaySamples - 1.0f, delaySamples);
-            int currReadPos = floorf(readPosition);
-
-            float nearestSample = delayData[currReadPos % delaySamples];
-            output = nearestSample;
-           
-            channelData[sample] = output;
-            delayData[currWritePos] = input;
-
-            currWritePos++;
+    float currWidth = widthSlider.getNextValue() * (float)getSampleRate();
+    float currPhaseOffset = phaseOffsetSlider.getNextValue();
+    int waveform = (int)paramWaveform.getTargetValue();
+
+    const int interpolation = (int)paramInterpolation.getTargetValue();
+    if (interpolation != currentInterpolation) {
+        allpassStates.clear(numInputChannels);
+        currentInterpolation = interpolation;
+    }
 
-            if (currWritePos >= delaySamples)
-                currWritePos -= delaySamples;
+    // Tempo sync reads the playhead once per block. While the transport runs
+    // the phase follows the PPQ position, so it neither drifts nor depends on
+    // the block size; while it is stopped the LFO runs free at the synced
+    // rate.
+    double phaseIncrement = currFrequency * inverseSR;
+    bool locked = false;
+    double blockPhase = 0.0;
+    int64 blockPosition = 0;
+
+    AudioPlayHead::CurrentPositionInfo position;
+    AudioPlayHead* playHead = getPlayHead();
+
+    if ((bool)syncButton.getTargetValue() && playHead != nullptr && playHead->getCurrentPosition(position) && position.bpm > 0.0) {
+        const double cyclesPerQuarter = 1.0 / getQuartersPerCycle(position);
+        phaseIncrement = position.bpm / 60.0 * cyclesPerQuarter / getSampleRate();
+
+        if (position.isPlaying) {
+            locked = true;
+            blockPhase = position.ppqPosition * cyclesPerQuarter;
+            blockPhase -= floor(blockPhase);
+            blockPosition = position.timeInSamples;
+        }
+    }
 
-            phase += currFrequency * inverseSR;
+    // Synced rates can go well past the 10 Hz of the slider.
+    lfo.setControlPeriod(ControlRateLfo::getControlPeriodFor(phaseIncrement * getSampleRate()));
+
+    // The delays are rendered once per chunk, in chunks of the size prepared
+    // for in case the host sends a larger block. Without a phase offset all
+    // channels share the first row; with one, channel c gets its own row
+    // with the LFO c times the offset ahead.
+    const int numModulationChannels = currPhaseOffset > 0.0f ? jmin(numInputChannels, lfoBuffer.getNumChannels() - 1) : 1;
+    float* previousData = lfoBuffer.getWritePointer(lfoBuffer.getNumChannels() - 1);
+    const int chunkSize = lfoBuffer.getNumSamples();
+
+    for (int start = 0; start < numSamples; start += chunkSize) {
+
+        const int numChunkSamples = jmin(chunkSize, numSamples - start);
+        const int writePosition = delayLine.getWritePosition();
+        const int64 chunkPosition = (locked ? blockPosition : freeRunningPosition) + start;
+
+        // A fade cut off by the transport starting, stopping or jumping back
+        // ends at once; a new one waits for the next grid point, so where it
+        // lies does not depend on the block size.
+        if (fadeWaveform != currentWaveform && (locked != fadeLocked || chunkPosition + waveformFadeLength < fadeStart))
+            currentWaveform = fadeWaveform;
+
+        if (fadeWaveform == currentWaveform && waveform != currentWaveform) {
+            const int64 offset = ((chunkPosition % waveformFadeLength) + waveformFadeLength) % waveformFadeLength;
+            fadeWaveform = waveform;
+            fadeStart = offset == 0 ? chunkPosition : chunkPosition + waveformFadeLength - offset;
+            fadeLocked = locked;
+        }
 
-            if (phase >= 1.0f) phase -= 1.0f;
+        // Returns the phase after the chunk; only the unshifted one is kept.
+        auto renderLfo = [&](float* destination, const int waveformToRender, const float phaseOffset) {
+            if (!locked) {
+                float phase = lfoPhase + phaseOffset;
+                phase -= floorf(phase);
+                return lfo.render(destination, numChunkSamples, waveformToRender, phase, (float)phaseIncrement);
+            }
+
+            lfo.renderLocked(destination, numChunkSamples, waveformToRender, blockPhase + phaseOffset, phaseIncrement, blockPosition, start);
+            return ControlRateLfo::getLockedPhase(blockPhase, phaseIncrement, start + numChunkSamples);
+        };
+
+        // Returns the phase after the chunk.
+        auto renderDelays = [&](float* destination, const float phaseOffset) {
+            float nextPhase;
+
+            if (fadeWaveform == currentWaveform) {
+                nextPhase = renderLfo(destination, currentWaveform, phaseOffset);
+            }
+            else {
+                // Both waveforms from the same phase, weighted by the place
+                // of each sample in the fade.
+                renderLfo(previousData, currentWaveform, phaseOffset);
+                nextPhase = renderLfo(destination, fadeWaveform, phaseOffset);
+
+                const float fadeStep = 1.0f / (float)waveformFadeLength;
+                const int fadeEnd = (int)jlimit((int64)0, (int64)numChunkSamples, fadeStart + waveformFadeLength - chunkPosition);
+                for (int sample = 0; sample < fadeEnd; ++sample) {
+                    const int64 fadePosition = jlimit((int64)0, (int64)waveformFadeLength, chunkPosition + sample + 1 - fadeStart);
+                    destination[sample] = previousData[sample] + (float)fadePosition * fadeStep * (destination[sample] - previousData[sample]);
+                }
+            }
+
+            FloatVectorOperations::multiply(destination, currWidth, numChunkSamples);
+            FloatVectorOperations::add(destination, (float)delayLine.minDelay, numChunkSamples);
+            return nextPhase;
+        };
+
+        const float nextPhase = renderDelays(lfoBuffer.getWritePointer(0), 0.0f);
+        for (int channel = 1; channel < numModulationChannels; ++channel)
+            renderDelays(lfoBuffer.getWritePointer(channel), (float)channel * currPhaseOffset);
+
+        lfoPhase = nextPhase;
+        if (chunkPosition + numChunkSamples >= fadeStart + waveformFadeLength)
+            currentWaveform = fadeWaveform;
+
+        // From here on the delays are read-only, and each channel touches only
+        // its own row of the delay line and its own allpass state, so the
+        // channels are independent of each other.
+        for (int channel = 0; channel < numInputChannels; channel++) {
+
+            float* channelData = buffer.getWritePointer(channel, start);
+            const float* delayData = lfoBuffer.getReadPointer(jmin(channel, numModulationChannels - 1));
+
+            // The delays keep the cubic minimum in every mode, so switching
+            // the interpolation does not move the pitch centre.
+            switch (interpolation) {
+                case interpolationLinear: {
+                    DelayInterpolation::Linear::State state;
+                    processChannel<DelayInterpolation::Linear>(channelData, channel, writePosition, delayData, numChunkSamples, state);
+                    break;
+                }
+                case interpolationLagrange: {
+                    DelayInterpolation::Lagrange3::State state;
+                    processChannel<DelayInterpolation::Lagrange3>(channelData, channel, writePosition, delayData, numChunkSamples, state);
+                    break;
+                }
+                case interpolationAllpass:
+                    processChannel<DelayInterpolation::Thiran>(channelData, channel, writePosition, delayData, numChunkSamples, allpassStates[channel]);
+                    break;
+                default: {
+                    DelayInterpolation::Hermite::State state;
+                    processChannel<DelayInterpolation::Hermite>(channelData, channel, writePosition, delayData, numChunkSamples, state);
+                    break;
+                }
+            }
         }
+
+        delayLine.advance(numChunkSamples);
     }
 
-    lfoPhase = phase;
-    delayWritePos = currWritePos;
+    freeRunningPosition += numSamples;
     
     //======================================
 
@@ -116,43 +234,70 @@ void VibratoAudioProcessor::processBlock(AudioSampleBuffer& buffer, MidiBuffer&
 
 //==============================================================================
 
-float VibratoAudioProcessor::lfo(float phase, int waveform)
+template <class Interpolation>
+void VibratoAudioProcessor::processChannel(float* channelData, const int channel, const int writePosition,
+                                           const float* delays, const int numSamples, typename Interpolation::State& state)
 {
-    float out = 0.0f;
+    int sample = 0;
 
-    if (waveform == waveformSine) {
-        out = 0.5f + 0.5f * sinf(2.f * M_PI * phase);
-    }
-    else if (waveform == waveformTriangle) {
-        if (phase < 0.25f)
-            out = 0.5f + 2.0f * phase;
-        else if (phase < 0.75f)
-            out = 1.0f - 2.0f * (phase - 0.25f);
-        else
-            out = 2.0f * (phase - 0.75f);
-    }
-    else if (waveform == waveformSawtooth) {
-        if (phase < 0.5f)
-            out = 0.5f + phase;
-        else
-            out = phase - 0.5f;
-    }
-    else {
-        if (phase < 0.5f)
-            out = 0.5f - phase;
-        else
-            out = 1.5f - phase;
-    }
+#if FRACTIONALDELAY_SSE2
+    sample = processConsecutive<Interpolation>(channelData, channel, writePosition, delays, numSamples,
+                                               std::is_empty<typename Interpolation::State>());
+#endif
+
+    for (; sample < numSamples; ++sample) {
+
+        const int position = writePosition + sample;
+        const float input = channelData[sample];
 
-    return out;
+        channelData[sample] = delayLine.readWith<Interpolation>(channel, position, delays[sample], state);
+        delayLine.write(channel, position, input);
+    }
 }
 
-//==============================================================================
+#if FRACTIONALDELAY_SSE2
+template <class Interpolation>
+int VibratoAudioProcessor::processConsecutive(float* channelData, const int channel, const int writePosition,
+                                              const float* delays, const int numSamples, std::true_type)
+{
+    int sample = 0;
 
+    for (; sample + 4 <= numSamples; sample += 4) {
 
+        const int position = writePosition + sample;
 
+        // Every delay is at least minDelay, so no output of the group reads
+        // an input of the group that has not been written.
+        for (int i = 0; i < 4; ++i)
+            delayLine.write(channel, position + i, channelData[sample + i]);
 
+        _mm_storeu_ps(channelData + sample,
+            delayLine.readConsecutive4<Interpolation>(channel, position, _mm_loadu_ps(delays + sample)));
+    }
 
+    return sample;
+}
+#endif
+
+//==============================================================================
+
+double VibratoAudioProcessor::getQuartersPerCycle(const AudioPlayHead::CurrentPositionInfo& position) const
+{
+    switch ((int)syncBox.getTargetValue()) {
+        case syncBar:
+            return position.timeSigDenominator > 0 ? 4.0 * position.timeSigNumerator / position.timeSigDenominator : 4.0;
+        case syncHalf: return 2.0;
+        case syncEighth: return 0.5;
+        case syncSixteenth: return 0.25;
+        case syncThirtySecond: return 0.125;
+        case syncQuarterTriplet: return 2.0 / 3.0;
+        case syncEighthTriplet: return 1.0 / 3.0;
+        case syncSixteenthTriplet: return 1.0 / 6.0;
+        case syncEighthDotted: return 0.75;
+        case syncSixteenthDotted: return 0.375;
+        default: return 1.0;
+    }
+}
 
 //==============================================================================
 
@@ -5,6 +5,8 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "PluginParameter.h"
+#include "ControlRateLfo.h"
+#include "FractionalDelayLine.h"
 
 //==============================================================================
 
@@ -85,19 +87,77 @@ public:
         waveformInverseSawtooth = 3,
     };
 
+    StringArray syncUI = {
+        "1 bar",
+        "1/2",
+        "1/4",
+        "1/8",
+        "1/16",
+        "1/32",
+        "1/4 triplet",
+        "1/8 triplet",
+        "1/16 triplet",
+        "1/8 dotted",
+        "1/16 dotted"
+    };
+
+    enum syncRate {
+        syncBar = 0,
+        syncHalf,
+        syncQuarter,
+        syncEighth,
+        syncSixteenth,
+        syncThirtySecond,
+        syncQuarterTriplet,
+        syncEighthTriplet,
+        syncSixteenthTriplet,
+        syncEighthDotted,
+        syncSixteenthDotted,
+    };
+
+    double getQuartersPerCycle(const AudioPlayHead::CurrentPositionInfo& position) const;
+
+    StringArray interpolationUI = {
+        "Linear",
+        "Cubic",
+        "Lagrange",
+        "Allpass"
+    };
+
+    enum interpolationIndex {
+        interpolationLinear = 0,
+        interpolationCubic,
+        interpolationLagrange,
+        interpolationAllpass,
+    };
+
     //======================================
 
-    AudioSampleBuffer delayBuffer;
-    
-    int delayWritePos;
-    int delaySamples;
-    int delayChannels;
-    
+    FractionalDelayLine<DelayInterpolation::Hermite> delayLine;
 
     float lfoPhase;
     float inverseSR;
 
-    float lfo(float phase, int waveform);
+    ControlRateLfo lfo;
+    AudioSampleBuffer lfoBuffer;
+
+    // A new waveform fades in over waveformFadeLength samples starting on
+    // the next multiple of that length, counted on the host timeline while
+    // locked and on freeRunningPosition otherwise. The fade is from
+    // currentWaveform to fadeWaveform; they are equal when none runs.
+    enum {
+        waveformFadeLength = 16 * ControlRateLfo::defaultControlPeriod,
+    };
+
+    int currentWaveform;
+    int fadeWaveform;
+    int64 fadeStart;
+    bool fadeLocked;
+    int64 freeRunningPosition;
+
+    // The allpass interpolation is recursive; one state per channel.
+    HeapBlock<DelayInterpolation::Thiran::State> allpassStates;
+    int currentInterpolation;
 
     //======================================
 
@@ -106,9 +166,34 @@ public:
     PluginParameterLinSlider widthSlider;
     PluginParameterLinSlider freqSlider;
     PluginParameterComboBox paramWaveform;
+    PluginParameterToggle syncButton;
+    PluginParameterComboBox syncBox;
+    PluginParameterComboBox paramInterpolation;
+    PluginParameterLinSlider phaseOffsetSlider;
 
 private:
     //==============================================================================
 
+    // Runs one channel of a chunk through the delay line, reading with the
+    // given interpolation policy.
+    template <class Interpolation>
+    void processChannel(float* channelData, const int channel, const int writePosition,
+                        const float* delays, const int numSamples, typename Interpolation::State& state);
+
+#if FRACTIONALDELAY_SSE2
+    // Stateless policies process four samples per step: the four inputs are
+    // written first, then the four outputs read. Returns the number of
+    // samples processed.
+    template <class Interpolation>
+    int processConsecutive(float* channelData, const int channel, const int writePosition,
+                           const float* delays, const int numSamples, std::true_type);
+
+    // A recursive policy needs each output before the next one.
+    template <class Interpolation>
+    int processConsecutive(float*, const int, const int, const float*, const int, std::false_type) { return 0; }
+#endif
+
+    //==============================================================================
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VibratoAudioProcessor)
 };
\ No newline at end of file